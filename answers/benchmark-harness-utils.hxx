@@ -0,0 +1,287 @@
+// Brejvinder
+#ifndef benchmark_harness_utils_hxx_
+#define benchmark_harness_utils_hxx_
+
+//===========================================================================
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "benchmark-utils.hxx"
+
+//===========================================================================
+
+//
+// cpu_affinity_guard
+// class
+//
+// Pins the calling thread to one CPU for the lifetime of the guard and then
+// restores the thread's previous affinity. Threads created while the guard
+// is active inherit the pinning, so it should not be used around code that
+// starts worker threads. pinned() is false if pinning is not supported
+// (i.e., not Linux) or failed.
+//
+class cpu_affinity_guard
+{
+private:
+  bool pinned_;
+#if defined(__linux__)
+  cpu_set_t old_;
+#endif
+
+public:
+  explicit cpu_affinity_guard(int const cpu) :
+    pinned_{false}
+  {
+#if defined(__linux__)
+    if (cpu < 0 || sched_getaffinity(0, sizeof old_, &old_) != 0)
+      return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pinned_ = sched_setaffinity(0, sizeof set, &set) == 0;
+#else
+    (void)cpu;
+#endif
+  }
+
+  cpu_affinity_guard(cpu_affinity_guard const&) = delete;
+  cpu_affinity_guard& operator =(cpu_affinity_guard const&) = delete;
+
+  ~cpu_affinity_guard()
+  {
+#if defined(__linux__)
+    if (pinned_)
+      sched_setaffinity(0, sizeof old_, &old_);
+#endif
+  }
+
+  bool pinned() const noexcept
+  {
+    return pinned_;
+  }
+};
+
+//===========================================================================
+
+struct benchmark_options
+{
+  std::size_t warmups = 1;
+  std::size_t trials = 5;
+  int cpu = -1;               // the CPU to pin single-threaded cases to
+};
+
+struct benchmark_result
+{
+  std::string name;
+  std::size_t trials;
+  bool pinned;
+  double samples;             // median samples per trial
+  double median;              // seconds
+  double p90;                 // seconds
+  double mad;                 // seconds (median absolute deviation)
+  double samples_per_second;  // median over trials
+  double ns_per_sample;       // median over trials
+};
+
+//===========================================================================
+
+namespace benchmark_detail {
+
+// return the p-th quantile (0 <= p <= 1) of v using linear interpolation...
+inline double quantile(std::vector<double> v, double const p)
+{
+  if (v.empty())
+    return std::nan("");
+
+  std::sort(v.begin(), v.end());
+  double const pos = p * (v.size() - 1);
+  std::size_t const i = std::size_t(pos);
+  if (i + 1 == v.size())
+    return v.back();
+  return v[i] + (pos - i) * (v[i + 1] - v[i]);
+}
+
+inline double median(std::vector<double> v)
+{
+  return quantile(std::move(v), 0.5);
+}
+
+// writes x as a JSON number, or as null if x is not finite...
+struct json_number
+{
+  double x;
+
+  friend std::ostream& operator <<(std::ostream& os, json_number const& n)
+  {
+    if (std::isfinite(n.x))
+      return os << n.x;
+    return os << "null";
+  }
+};
+
+inline std::string json_escape(std::string const& s)
+{
+  std::string r;
+  for (char const c : s)
+  {
+    if (c == '"' || c == '\\')
+      r += '\\';
+    r += c;
+  }
+  return r;
+}
+
+} // namespace benchmark_detail
+
+//===========================================================================
+
+//
+// benchmark_harness
+// class
+//
+// Runs named benchmark cases and records statistics for each. A case is a
+// callable that does some work and returns the number of samples it
+// processed. Each case is run options.warmups times untimed and then
+// options.trials times timed with benchmark<steady_clock>; the constructor
+// throws std::invalid_argument if options.trials is 0. Results can be
+// written as JSON or CSV. Statistics that are not finite (e.g., the rate
+// of a case that returned 0 samples) are written as null in JSON.
+//
+// Cases that start threads should be run with pin set to false (see
+// cpu_affinity_guard).
+//
+class benchmark_harness
+{
+public:
+  using clock_type = std::chrono::steady_clock;
+
+private:
+  benchmark_options options_;
+  std::vector<benchmark_result> results_;
+
+public:
+  explicit benchmark_harness(benchmark_options const& options = {}) :
+    options_{options}
+  {
+    if (options_.trials < 1)
+      throw std::invalid_argument("benchmark_harness: trials must be >= 1");
+  }
+
+  benchmark_options const& options() const noexcept
+  {
+    return options_;
+  }
+
+  std::vector<benchmark_result> const& results() const noexcept
+  {
+    return results_;
+  }
+
+  template <typename Case>
+  benchmark_result const& run(
+    std::string name, Case&& c, bool const pin = true
+  )
+  {
+    using namespace benchmark_detail;
+
+    cpu_affinity_guard guard(pin ? options_.cpu : -1);
+
+    for (std::size_t i = 0; i != options_.warmups; ++i)
+      c();
+
+    std::vector<double> seconds, samples, rates, ns;
+    benchmark<clock_type> bm;
+    for (std::size_t i = 0; i != options_.trials; ++i)
+    {
+      bm.start();
+      double const n = double(c());
+      bm.stop();
+
+      double const s = duration_convert<double>(bm.duration()).count();
+      seconds.push_back(s);
+      samples.push_back(n);
+      rates.push_back(n / s);
+      ns.push_back(s / n * 1e9);
+    }
+
+    double const med = median(seconds);
+    std::vector<double> deviations;
+    for (auto const& s : seconds)
+      deviations.push_back(std::abs(s - med));
+
+    results_.push_back({
+      std::move(name),
+      options_.trials,
+      guard.pinned(),
+      median(samples),
+      med,
+      quantile(seconds, 0.9),
+      median(deviations),
+      median(rates),
+      median(ns)
+    });
+    return results_.back();
+  }
+
+  void write_csv(std::ostream& os) const
+  {
+    auto const old_precision = os.precision(9);
+    os << "name,trials,pinned,samples,median_s,p90_s,mad_s,"
+          "samples_per_s,ns_per_sample\n";
+    for (auto const& r : results_)
+      os
+        << r.name << ','
+        << r.trials << ','
+        << r.pinned << ','
+        << r.samples << ','
+        << r.median << ','
+        << r.p90 << ','
+        << r.mad << ','
+        << r.samples_per_second << ','
+        << r.ns_per_sample << '\n';
+    os.precision(old_precision);
+  }
+
+  void write_json(std::ostream& os) const
+  {
+    using benchmark_detail::json_escape;
+    using benchmark_detail::json_number;
+
+    auto const old_precision = os.precision(9);
+    os << "[\n";
+    for (std::size_t i = 0; i != results_.size(); ++i)
+    {
+      auto const& r = results_[i];
+      os
+        << "  {\"name\": \"" << json_escape(r.name) << '"'
+        << ", \"trials\": " << r.trials
+        << ", \"pinned\": " << (r.pinned ? "true" : "false")
+        << ", \"samples\": " << json_number{r.samples}
+        << ", \"median_s\": " << json_number{r.median}
+        << ", \"p90_s\": " << json_number{r.p90}
+        << ", \"mad_s\": " << json_number{r.mad}
+        << ", \"samples_per_s\": " << json_number{r.samples_per_second}
+        << ", \"ns_per_sample\": " << json_number{r.ns_per_sample}
+        << '}' << (i + 1 != results_.size() ? "," : "") << '\n';
+    }
+    os << "]\n";
+    os.precision(old_precision);
+  }
+};
+
+//===========================================================================
+
+#endif // #ifndef benchmark_harness_utils_hxx_
@@ -0,0 +1,38 @@
+// Brejvinder
+#ifndef cache_utils_hxx_
+#define cache_utils_hxx_
+
+//===========================================================================
+
+#include <cstddef>
+
+//===========================================================================
+
+//
+// cache_line_size
+//
+// The assumed size of a cache line in bytes. (std::hardware_destructive_
+// interference_size is not available on all of the compilers used for this
+// project.)
+//
+inline constexpr std::size_t cache_line_size = 64;
+
+//===========================================================================
+
+//
+// cache_padded<T>
+// class template
+//
+// Wraps a T so that it starts on its own cache line and no other
+// cache_padded object shares that line. This avoids false sharing when
+// each thread updates its own element of an array.
+//
+template <typename T>
+struct alignas(cache_line_size) cache_padded
+{
+  T value;
+};
+
+//===========================================================================
+
+#endif // #ifndef cache_utils_hxx_
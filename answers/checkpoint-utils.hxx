@@ -0,0 +1,729 @@
+// Brejvinder
+#ifndef checkpoint_utils_hxx_
+#define checkpoint_utils_hxx_
+
+//===========================================================================
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "cache-utils.hxx"
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "executor-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+//===========================================================================
+//
+// Checkpoint file format (version 2)
+//
+// All integers are stored as 64-bit little-endian values and floating-point
+// values as the bits of an IEEE-754 double:
+//
+//   "MCCK" magic, u64 version, u64 run id,
+//   merged tally,
+//   u64 number of streams, then for each stream:
+//     engine state, stream tally,
+//   u64 FNV-1a hash of all of the preceding bytes.
+//
+// A tally is stored as count (tally_count), count, true count
+// (tally_predicate) or count, mean, m2 and their compensation terms
+// (tally_mean_variance<double>, see its state()) and a
+// tally that wraps one of these (e.g., telemetry_tally) as the wrapped
+// tally. A philox4x32 state is stored as key, stream, block, index.
+//
+//===========================================================================
+
+namespace checkpoint_detail {
+
+inline constexpr char magic[4] = { 'M', 'C', 'C', 'K' };
+inline constexpr std::uint64_t version = 2;
+
+// 64-bit FNV-1a...
+inline constexpr std::uint64_t fnv1a_basis = 0xcbf29ce484222325ULL;
+
+inline std::uint64_t fnv1a(
+  std::uint64_t hash, unsigned char const* p, std::size_t const n
+) noexcept
+{
+  for (std::size_t i = 0; i != n; ++i)
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+// Writes bytes to a stream while hashing them with 64-bit FNV-1a...
+class hashing_writer
+{
+private:
+  std::ostream* os_;
+  std::uint64_t hash_;
+
+public:
+  explicit hashing_writer(std::ostream& os) :
+    os_{&os},
+    hash_{fnv1a_basis}
+  {
+  }
+
+  std::uint64_t hash() const noexcept
+  {
+    return hash_;
+  }
+
+  void bytes(unsigned char const* p, std::size_t const n)
+  {
+    hash_ = fnv1a(hash_, p, n);
+    os_->write(reinterpret_cast<char const*>(p), n);
+  }
+
+  void u64(std::uint64_t const v)
+  {
+    unsigned char b[8];
+    for (int i = 0; i != 8; ++i)
+      b[i] = static_cast<unsigned char>(v >> (8 * i));
+    bytes(b, sizeof b);
+  }
+
+  void f64(double const d)
+  {
+    std::uint64_t v;
+    std::memcpy(&v, &d, sizeof v);
+    u64(v);
+  }
+};
+
+// Reads bytes from a stream while hashing them with 64-bit FNV-1a...
+class hashing_reader
+{
+private:
+  std::istream* is_;
+  std::uint64_t hash_;
+
+public:
+  explicit hashing_reader(std::istream& is) :
+    is_{&is},
+    hash_{fnv1a_basis}
+  {
+  }
+
+  std::uint64_t hash() const noexcept
+  {
+    return hash_;
+  }
+
+  void bytes(unsigned char* p, std::size_t const n)
+  {
+    if (!is_->read(reinterpret_cast<char*>(p), n))
+      throw std::runtime_error("checkpoint: truncated file");
+    hash_ = fnv1a(hash_, p, n);
+  }
+
+  std::uint64_t u64()
+  {
+    unsigned char b[8];
+    bytes(b, sizeof b);
+    std::uint64_t v = 0;
+    for (int i = 0; i != 8; ++i)
+      v |= std::uint64_t(b[i]) << (8 * i);
+    return v;
+  }
+
+  double f64()
+  {
+    std::uint64_t const v = u64();
+    double d;
+    std::memcpy(&d, &v, sizeof d);
+    return d;
+  }
+};
+
+inline void write(hashing_writer& w, tally_count const& t)
+{
+  w.u64(t.count());
+}
+
+inline void read(hashing_reader& r, tally_count& t)
+{
+  t = tally_count(r.u64());
+}
+
+inline void write(hashing_writer& w, tally_predicate const& t)
+{
+  w.u64(t.count());
+  w.u64(t.true_count());
+}
+
+inline void read(hashing_reader& r, tally_predicate& t)
+{
+  auto const n = r.u64();
+  t = tally_predicate(n, r.u64());
+}
+
+template <bool Compensated>
+void write(hashing_writer& w, tally_mean_variance<double, Compensated> const& t)
+{
+  auto const s = t.state();
+  w.u64(s.n);
+  w.f64(s.mean);
+  w.f64(s.m2);
+  w.f64(s.mean_c);
+  w.f64(s.m2_c);
+}
+
+template <bool Compensated>
+void read(hashing_reader& r, tally_mean_variance<double, Compensated>& t)
+{
+  typename tally_mean_variance<double, Compensated>::state_type s;
+  s.n = r.u64();
+  s.mean = r.f64();
+  s.m2 = r.f64();
+  s.mean_c = r.f64();
+  s.m2_c = r.f64();
+  t = tally_mean_variance<double, Compensated>(s);
+}
+
+// a tally that wraps another (e.g., telemetry_tally) is stored as that...
+template <
+  typename Tally,
+  typename = std::void_t<
+    typename Tally::tally_type, decltype(std::declval<Tally const&>().get())
+  >
+>
+void write(hashing_writer& w, Tally const& t)
+{
+  write(w, t.get());
+}
+
+template <
+  typename Tally,
+  typename = std::void_t<
+    typename Tally::tally_type, decltype(std::declval<Tally const&>().get())
+  >
+>
+void read(hashing_reader& r, Tally& t)
+{
+  typename Tally::tally_type inner;
+  read(r, inner);
+  t = Tally(inner);
+}
+
+inline void write(hashing_writer& w, philox4x32::state_type const& s)
+{
+  w.u64(s.key);
+  w.u64(s.stream);
+  w.u64(s.block);
+  w.u64(s.index);
+}
+
+inline void read(hashing_reader& r, philox4x32::state_type& s)
+{
+  s.key = r.u64();
+  s.stream = r.u64();
+  s.block = r.u64();
+  s.index = std::uint32_t(r.u64());
+}
+
+//
+// Writes bytes to path and, where supported (POSIX), flushes them to the
+// storage device before returning. Throws std::runtime_error on failure.
+//
+inline void write_file_synced(std::string const& path, std::string const& bytes)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  int const fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    throw std::runtime_error("checkpoint: cannot write " + path);
+
+  bool ok = true;
+  for (std::size_t i = 0; ok && i != bytes.size(); )
+  {
+    auto const n = ::write(fd, bytes.data() + i, bytes.size() - i);
+    ok = n > 0;
+    i += ok ? std::size_t(n) : 0;
+  }
+  ok = ok && ::fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok)
+    throw std::runtime_error("checkpoint: cannot write " + path);
+#else
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  os.write(bytes.data(), bytes.size());
+  os.flush();
+  if (!os)
+    throw std::runtime_error("checkpoint: cannot write " + path);
+#endif
+}
+
+//
+// Flushes the directory entry of path (i.e., a rename to path) to the
+// storage device where supported. Failure is ignored: the file itself is
+// already on the device.
+//
+inline void sync_directory_of(std::string const& path)
+{
+#if defined(__unix__) || defined(__APPLE__)
+  auto const slash = path.find_last_of('/');
+  std::string const dir =
+    slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+  int const fd = ::open(dir.c_str(), O_RDONLY);
+  if (fd >= 0)
+  {
+    ::fsync(fd);
+    ::close(fd);
+  }
+#else
+  (void)path;
+#endif
+}
+
+//
+// Forwards to Controller but hides any remaining() member, so that the
+// controller can only stop a stream after a whole block...
+//
+template <typename Controller>
+class block_boundary_controller
+{
+private:
+  Controller* c_;
+
+public:
+  explicit block_boundary_controller(Controller& c) noexcept :
+    c_{&c}
+  {
+  }
+
+  template <typename Tally>
+  bool operator ()(Tally const& tally, std::size_t const n)
+  {
+    return monte_carlo_detail::control_block(*c_, tally, n);
+  }
+};
+
+} // namespace checkpoint_detail
+
+//===========================================================================
+
+template <typename Tally, typename Engine = philox4x32>
+struct stream_checkpoint
+{
+  typename Engine::state_type engine;
+  Tally tally;
+};
+
+template <typename Tally, typename Engine = philox4x32>
+struct checkpoint
+{
+  std::uint64_t run_id;
+  Tally merged;
+  std::vector<stream_checkpoint<Tally, Engine>> streams;
+};
+
+//
+// save_checkpoint(path, cp)
+// function
+//
+// Writes cp to path + ".tmp", flushes it to the storage device (fsync) and
+// then renames it to path. Since the rename is atomic (on POSIX file
+// systems) and the data is on the device before it, path always holds a
+// complete checkpoint, even after a power failure. Throws
+// std::runtime_error on failure.
+//
+template <typename Tally, typename Engine>
+void save_checkpoint(std::string const& path, checkpoint<Tally, Engine> const& cp)
+{
+  using namespace checkpoint_detail;
+
+  std::string const tmp = path + ".tmp";
+  std::ostringstream os(std::ios::binary);
+  {
+    hashing_writer w(os);
+    w.bytes(reinterpret_cast<unsigned char const*>(magic), sizeof magic);
+    w.u64(version);
+    w.u64(cp.run_id);
+    write(w, cp.merged);
+    w.u64(cp.streams.size());
+    for (auto const& s : cp.streams)
+    {
+      write(w, s.engine);
+      write(w, s.tally);
+    }
+    w.u64(w.hash());
+  }
+  write_file_synced(tmp, os.str());
+
+  if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("checkpoint: cannot rename " + tmp);
+  sync_directory_of(path);
+}
+
+//
+// load_checkpoint<Tally, Engine>(path)
+// function
+//
+// Returns the checkpoint stored in path or std::nullopt if path does not
+// exist. Throws std::runtime_error if the file is not a valid checkpoint.
+// The file's hash is checked before anything in it is parsed, so a corrupt
+// file cannot cause large allocations.
+//
+template <typename Tally, typename Engine = philox4x32>
+std::optional<checkpoint<Tally, Engine>> load_checkpoint(std::string const& path)
+{
+  using namespace checkpoint_detail;
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return std::nullopt;
+
+  std::string const bytes{std::istreambuf_iterator<char>(file), {}};
+  auto const data = reinterpret_cast<unsigned char const*>(bytes.data());
+  if (bytes.size() < sizeof magic + 8 ||
+      std::memcmp(data, magic, sizeof magic) != 0)
+    throw std::runtime_error("checkpoint: " + path + " is not a checkpoint");
+
+  // check the hash before trusting any size stored in the file...
+  std::size_t const size = bytes.size() - 8;
+  std::uint64_t stored = 0;
+  for (int i = 0; i != 8; ++i)
+    stored |= std::uint64_t(data[size + i]) << (8 * i);
+  if (fnv1a(fnv1a_basis, data, size) != stored)
+    throw std::runtime_error("checkpoint: " + path + " is corrupt");
+
+  std::istringstream is(bytes, std::ios::binary);
+  hashing_reader r(is);
+  unsigned char m[sizeof magic];
+  r.bytes(m, sizeof m);
+  if (r.u64() != version)
+    throw std::runtime_error("checkpoint: " + path + " is not a checkpoint");
+
+  checkpoint<Tally, Engine> cp;
+  cp.run_id = r.u64();
+  read(r, cp.merged);
+
+  // each stream takes at least one u64, so bound the count by the file...
+  std::uint64_t const nstreams = r.u64();
+  if (nstreams > (size - std::size_t(is.tellg())) / 8)
+    throw std::runtime_error("checkpoint: " + path + " is corrupt");
+  cp.streams.resize(nstreams);
+  for (auto& s : cp.streams)
+  {
+    read(r, s.engine);
+    read(r, s.tally);
+  }
+
+  std::uint64_t const hash = r.hash();
+  if (r.u64() != hash)
+    throw std::runtime_error("checkpoint: " + path + " is corrupt");
+
+  return cp;
+}
+
+//===========================================================================
+
+//
+// checkpoint_writer<Tally, Engine>
+// class template
+//
+// Periodically saves the state of nstreams streams to a checkpoint file
+// from a background thread.
+//
+// Workers publish(k, engine, tally) their stream's state into stream k's
+// cache-padded slot, e.g., after each chunk. This only copies the state
+// under the slot's own mutex, which nothing but the writer thread ever
+// contends for, and only briefly. The writer copies every slot into its own
+// snapshot buffer, then releases the slots and does the file I/O on that
+// buffer. So the workers never wait for I/O (i.e., the slots and the
+// snapshot are a double buffer). The file is replaced with an atomic
+// rename.
+//
+// If a write fails the writer thread keeps the exception (see error())
+// and tries again at the next interval. stop() stops the thread, writes a
+// final checkpoint and throws if that write fails.
+//
+template <typename Tally, typename Engine = philox4x32>
+class checkpoint_writer
+{
+public:
+  using size_type = std::size_t;
+  using clock_type = std::chrono::steady_clock;
+  using checkpoint_type = checkpoint<Tally, Engine>;
+
+private:
+  struct slot
+  {
+    std::mutex mutex;
+    stream_checkpoint<Tally, Engine> state;
+  };
+
+  std::string path_;
+  std::uint64_t run_id_;
+  clock_type::duration interval_;
+  size_type nstreams_;
+  std::unique_ptr<cache_padded<slot>[]> slots_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+  std::thread thread_;
+  std::atomic<size_type> writes_;
+  std::exception_ptr error_;
+  checkpoint_type snapshot_;
+
+  void write_now()
+  {
+    std::exception_ptr error;
+    try
+    {
+      snapshot_.run_id = run_id_;
+      snapshot_.merged = Tally();
+      snapshot_.streams.resize(nstreams_);
+      for (size_type k = 0; k != nstreams_; ++k)
+      {
+        {
+          std::lock_guard<std::mutex> guard(slots_[k].value.mutex);
+          snapshot_.streams[k] = slots_[k].value.state;
+        }
+        snapshot_.merged += snapshot_.streams[k].tally;
+      }
+
+      save_checkpoint(path_, snapshot_);
+      writes_.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (...)
+    {
+      error = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    error_ = error;
+  }
+
+  void writer_loop()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, interval_, [this]() { return stop_; }))
+    {
+      lock.unlock();
+      write_now();
+      lock.lock();
+    }
+  }
+
+public:
+  checkpoint_writer(
+    std::string path,
+    std::uint64_t const run_id,
+    std::vector<stream_checkpoint<Tally, Engine>> const& initial,
+    clock_type::duration const interval = std::chrono::seconds(10)
+  ) :
+    path_{std::move(path)},
+    run_id_{run_id},
+    interval_{interval},
+    nstreams_{initial.size()},
+    slots_{new cache_padded<slot>[initial.size()]},
+    stop_{true},
+    writes_{}
+  {
+    for (size_type k = 0; k != nstreams_; ++k)
+      slots_[k].value.state = initial[k];
+  }
+
+  checkpoint_writer(checkpoint_writer const&) = delete;
+  checkpoint_writer& operator =(checkpoint_writer const&) = delete;
+
+  ~checkpoint_writer()
+  {
+    if (thread_.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+      }
+      cv_.notify_all();
+      thread_.join();
+    }
+  }
+
+  // the number of checkpoints written so far...
+  size_type writes() const noexcept
+  {
+    return writes_.load(std::memory_order_relaxed);
+  }
+
+  // the exception of the last write if it failed (or nullptr)...
+  std::exception_ptr error()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return error_;
+  }
+
+  void publish(size_type const k, Engine const& engine, Tally const& tally)
+  {
+    std::lock_guard<std::mutex> guard(slots_[k].value.mutex);
+    slots_[k].value.state.engine = engine.state();
+    slots_[k].value.state.tally = tally;
+  }
+
+  void start()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!stop_)
+      return;
+    stop_ = false;
+    thread_ = std::thread([this]() { writer_loop(); });
+  }
+
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (stop_)
+        return;
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    write_now();
+    if (auto const e = error())
+      std::rethrow_exception(e);
+  }
+};
+
+//===========================================================================
+
+//
+// monte_carlo_checkpointed<Tally>(ex, streams, nstreams, n, make_op,
+//   path, run_id, c, interval, chunk_size)
+// function
+//
+// Runs nstreams streams of n samples each on ex, where stream k draws from
+// streams.stream(k) through make_op(engine) (as in
+// monte_carlo_parallel_streams()), and checkpoints them to path every
+// interval. If path holds a checkpoint for run_id, the run resumes from it
+// exactly: the resumed result is bit-identical to an uninterrupted run.
+// Otherwise a new run is started (and std::runtime_error is thrown if path
+// holds a checkpoint of a different run).
+//
+// Controller c is checked after each block against each stream's tally
+// (its remaining(), if any, is not used). When it stops (e.g., when the job
+// is being preempted) the streams stop early, a final checkpoint is written
+// and the partial result is returned. Since streams only stop after whole
+// blocks, a resumed stream's blocks line up with an uninterrupted run's.
+//
+// Checkpoints that fail to be written are retried every interval; if the
+// final checkpoint cannot be written std::runtime_error is thrown.
+//
+// As in monte_carlo_parallel(), each stream's tally starts as a copy of
+// prototype (to which the checkpointed tally is then added) and is passed
+// to bind_worker(w).
+//
+// NOTE: chunk_size must be a multiple of BlockSize so that a resumed stream
+//       draws its random numbers in the same blocks as an uninterrupted one.
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename StreamFactory,
+  typename MakeOp,
+  typename Controller
+>
+Tally monte_carlo_checkpointed(
+  work_stealing_executor& ex,
+  StreamFactory const& streams,
+  std::size_t const nstreams,
+  std::size_t const n,
+  MakeOp make_op,
+  std::string const& path,
+  std::uint64_t const run_id,
+  Controller&& c,
+  std::chrono::steady_clock::duration const interval =
+    std::chrono::seconds(10),
+  std::size_t const chunk_size = default_monte_carlo_chunk_size,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using engine_type = typename StreamFactory::engine_type;
+  using controller_type =
+    checkpoint_detail::block_boundary_controller<
+      std::remove_reference_t<Controller>
+    >;
+  using size_type = std::size_t;
+
+  if (chunk_size % BlockSize != 0)
+    throw std::invalid_argument("chunk_size must be a multiple of BlockSize");
+
+  std::vector<stream_checkpoint<Tally, engine_type>> initial(nstreams);
+  if (auto const cp = load_checkpoint<Tally, engine_type>(path))
+  {
+    if (cp->run_id != run_id || cp->streams.size() != nstreams)
+      throw std::runtime_error("checkpoint: " + path + " is for another run");
+    initial = cp->streams;
+    for (auto const& s : initial)
+      if (s.tally.count() < n && s.tally.count() % BlockSize != 0)
+        throw std::runtime_error("checkpoint: " + path + " is misaligned");
+  }
+  else
+    for (size_type k = 0; k != nstreams; ++k)
+      initial[k] = { streams.stream(k).state(), Tally() };
+
+  checkpoint_writer<Tally, engine_type> writer(path, run_id, initial, interval);
+  writer.start();
+
+  controller_type bc(c);
+
+  std::vector<cache_padded<Tally>> tallies(nstreams);
+  ex.run_indexed(nstreams, [&](size_type k, size_type w) {
+    engine_type engine(initial[k].engine);
+    Tally& tally = tallies[k].value;
+    tally = prototype;
+    bind_worker(tally, w);
+    tally += initial[k].tally;
+    auto op = make_op(engine);
+
+    for (bool run = true; run && tally.count() < n; )
+    {
+      size_type const limit =
+        std::min(n, (tally.count() / chunk_size + 1) * chunk_size);
+      chunk_controller<controller_type> cc(bc, limit);
+      monte_carlo_tally_batched<Sample, BlockSize>(cc, tally, op);
+      writer.publish(k, engine, tally);
+      run = !cc.stopped();
+    }
+  });
+
+  writer.stop();
+
+  Tally total;
+  for (auto const& t : tallies)
+    total += t.value;
+  return total;
+}
+
+//===========================================================================
+
+#endif // #ifndef checkpoint_utils_hxx_
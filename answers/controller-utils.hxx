@@ -6,9 +6,13 @@
 
 //===========================================================================
 
+#include <cmath>
 #include <mutex>
 #include <atomic>
+#include <limits>
 #include <utility>
+#include <algorithm>
+#include <type_traits>
 #include "benchmark-utils.hxx"
 
 //===========================================================================
@@ -29,6 +33,9 @@
 
 struct never_stop_controller
 {
+  // lets the monte_carlo drivers drop the controller check entirely...
+  static constexpr bool never_stops = true;
+
   // ignore all tally objects and return true...
   template <typename Tally>
   constexpr bool operator ()(Tally const&) const noexcept
@@ -45,6 +52,10 @@ private:
   std::size_t const n_;
 
 public:
+  // lets the monte_carlo drivers run a counted loop (see
+  // monte_carlo_detail::is_count_controller)...
+  static constexpr bool counts_only = true;
+
   constexpr stop_after_count_controller() noexcept : 
     n_{}
   { 
@@ -71,6 +82,50 @@ public:
   {
     return tally.count() < n_;
   }
+
+  // return the number of tallies left to do (used by batched drivers)...
+  template <typename Tally>
+  constexpr std::size_t remaining(Tally const& tally) const
+    noexcept(noexcept(tally.count()))
+  {
+    return tally.count() < n_ ? n_ - tally.count() : 0;
+  }
+};
+
+//===========================================================================
+
+//
+// stop_after_fixed_count_controller<N>
+// class template
+//
+// Like stop_after_count_controller(N) except that the count is a
+// compile-time constant, so that monte_carlo() can run a loop with a
+// constant trip count.
+//
+template <std::size_t N>
+struct stop_after_fixed_count_controller
+{
+  static constexpr bool counts_only = true;
+  static constexpr std::size_t fixed_count = N;
+
+  constexpr std::size_t count() const noexcept
+  {
+    return N;
+  }
+
+  template <typename Tally>
+  constexpr bool operator ()(Tally const& tally) const
+    noexcept(noexcept(tally.count() < N))
+  {
+    return tally.count() < N;
+  }
+
+  template <typename Tally>
+  constexpr std::size_t remaining(Tally const& tally) const
+    noexcept(noexcept(tally.count()))
+  {
+    return tally.count() < N ? N - tally.count() : 0;
+  }
 };
 
 //===========================================================================
@@ -204,6 +259,14 @@ public:
   {
     return stop_.load(std::memory_order_relaxed) && (tally.count() < n_);
   }
+
+  // return the number of tallies left to do (used by batched drivers)...
+  template <typename Tally>
+  std::size_t remaining(Tally const& tally) const
+    noexcept(noexcept(tally.count()))
+  {
+    return tally.count() < n_ ? n_ - tally.count() : 0;
+  }
 };
 
 //===========================================================================
@@ -252,4 +315,382 @@ public:
 
 //===========================================================================
 
+//
+// stop_at_deadline_controller<ClockType>
+//
+// This is a lock-free replacement for stop_after_duration_controller that
+// is intended to be shared by many threads. Instead of locking a mutex and
+// reading the clock for every sample, it:
+//
+//   * holds the deadline as an atomic clock tick count,
+//   * only reads the clock when tally.count() is a multiple of a
+//     power-of-two stride, and,
+//   * adjusts that stride so that the time taken to run one stride's
+//     worth of samples stays within the latency bound given to the
+//     constructor, i.e., the run overshoots the deadline by roughly no
+//     more than that bound.
+//
+// The stride is computed from the sampling rate observed by the calling
+// thread: the first clock read of a thread (and tally) after the
+// controller was (re)started records tally.count() and the time, and later
+// reads divide the samples since then by the time since then. Samples that
+// were already in the tally (e.g., one resumed from a checkpoint) are thus
+// not mistaken for a high rate. This per-thread base is kept in a
+// thread_local that is only touched when the clock is read.
+//
+// NOTE: Tally must have a count() member function.
+//
+template <typename ClockType>
+class stop_at_deadline_controller
+{
+public:
+  using clock_type = ClockType;
+  using rep_type = typename clock_type::rep;
+  using duration_type = typename clock_type::duration;
+  using time_point_type = typename clock_type::time_point;
+  using size_type = std::size_t;
+
+  // the clock is read at least once every 2**max_stride_shift samples...
+  static constexpr unsigned max_stride_shift = 24;
+
+private:
+  // reset() takes a new epoch so stale thread_local bases are never used...
+  static inline std::atomic<unsigned long> next_epoch_{};
+
+  std::atomic<unsigned long> epoch_;
+  std::atomic<rep_type> deadline_;
+  std::atomic<unsigned> shift_;
+  std::atomic<bool> run_;
+  duration_type latency_;
+
+  static rep_type now_ticks() noexcept
+  {
+    return clock_type::now().time_since_epoch().count();
+  }
+
+  void update_stride(
+    void const* const tally, size_type const count, rep_type const now
+  ) noexcept
+  {
+    // where the calling thread's tally was at its first read since reset()...
+    struct base_type
+    {
+      unsigned long epoch;
+      void const* tally;
+      size_type count;
+      rep_type time;
+    };
+    static thread_local base_type base{};
+
+    unsigned long const epoch = epoch_.load(std::memory_order_relaxed);
+    if (base.epoch != epoch || base.tally != tally || count < base.count)
+    {
+      base = base_type{ epoch, tally, count, now };
+      return;
+    }
+
+    rep_type const elapsed = now - base.time;
+    if (elapsed <= 0)
+      return;
+
+    // number of samples this thread can do within latency_...
+    auto const stride =
+      static_cast<long double>(count - base.count) * latency_.count() / elapsed;
+
+    unsigned shift = 0;
+    while (shift < max_stride_shift && (size_type(2) << shift) <= stride)
+      ++shift;
+
+    // only write when the value changes to keep the cache line shared...
+    if (shift_.load(std::memory_order_relaxed) != shift)
+      shift_.store(shift, std::memory_order_relaxed);
+  }
+
+public:
+  stop_at_deadline_controller() = delete;
+  stop_at_deadline_controller(
+    duration_type const& d,
+    duration_type const& latency = std::chrono::milliseconds(1)
+  ) :
+    epoch_{},
+    deadline_{},
+    shift_{},
+    run_{true},
+    latency_{latency}
+  {
+    reset(d);
+  }
+  stop_at_deadline_controller(stop_at_deadline_controller const&) = delete;
+  stop_at_deadline_controller(stop_at_deadline_controller&&) = delete;
+  stop_at_deadline_controller& operator =(
+    stop_at_deadline_controller const&) = delete;
+  stop_at_deadline_controller& operator =(
+    stop_at_deadline_controller&&) = delete;
+
+  // restart the controller so that it expires d from now...
+  void reset(duration_type const& d) noexcept
+  {
+    rep_type const now = now_ticks();
+    epoch_.store(
+      next_epoch_.fetch_add(1, std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed
+    );
+    deadline_.store(now + d.count(), std::memory_order_relaxed);
+    shift_.store(0, std::memory_order_relaxed);
+    run_.store(true, std::memory_order_relaxed);
+  }
+
+  void stop() noexcept
+  {
+    run_.store(false, std::memory_order_relaxed);
+  }
+
+  bool expired() const noexcept
+  {
+    return !run_.load(std::memory_order_relaxed);
+  }
+
+  time_point_type deadline() const noexcept
+  {
+    return time_point_type(
+      duration_type(deadline_.load(std::memory_order_relaxed))
+    );
+  }
+
+  duration_type latency() const noexcept
+  {
+    return latency_;
+  }
+
+  size_type stride() const noexcept
+  {
+    return size_type(1) << shift_.load(std::memory_order_relaxed);
+  }
+
+  // return false once the deadline has passed (or stop() was called)...
+  template <typename Tally>
+  bool operator ()(Tally const& tally) noexcept(noexcept(tally.count()))
+  {
+    return (*this)(tally, 1);
+  }
+
+  //
+  // Batched form: n samples were just tallied. The clock is read whenever
+  // tally.count() crossed a multiple of stride() within those n samples.
+  //
+  template <typename Tally>
+  bool operator ()(Tally const& tally, size_type const n)
+    noexcept(noexcept(tally.count()))
+  {
+    size_type const count = tally.count();
+    unsigned const shift = shift_.load(std::memory_order_relaxed);
+    if ((count >> shift) == ((count - n) >> shift))
+      return run_.load(std::memory_order_relaxed);
+
+    rep_type const now = now_ticks();
+    if (deadline_.load(std::memory_order_relaxed) <= now)
+    {
+      stop();
+      return false;
+    }
+
+    update_stride(&tally, count, now);
+    return run_.load(std::memory_order_relaxed);
+  }
+};
+
+//===========================================================================
+
+//
+// stop_at_precision_controller
+//
+// This controller stops once the confidence interval of the tally's
+// estimate is narrow enough, i.e., once
+//
+//   z * scale * standard_error(tally) <= half_width
+//
+// where z defaults to the two-sided 95% normal quantile and scale is
+// applied to the estimate (e.g., 4 when estimating pi from the proportion
+// of points in a quarter circle). The standard error is computed from:
+//
+//   * Bernoulli tallies (those with true_count(), e.g., tally_predicate)
+//     with the Agresti-Coull interval, i.e., sqrt(p * (1 - p) / m) where
+//     m = n + z * z and p = (true_count + z * z / 2) / m, or,
+//   * mean tallies (those with variance(), e.g., tally_mean_variance) as
+//     sqrt(variance / n).
+//
+// Unlike the plain sqrt(p * (1 - p) / n), the Agresti-Coull error is not 0
+// when no (or every) sample so far is a success, so a rare event does not
+// stop the run at the first checkpoint. Likewise, a mean tally whose
+// variance is still 0 is treated as having an unknown (infinite) error.
+//
+// The rule is evaluated only at geometric checkpoints: first when the
+// count reaches min_count and then at the count predicted to reach the
+// target (but never more than a factor of growth later). Between
+// checkpoints the cost is one relaxed atomic load and a comparison. The
+// state is atomic so that the controller may be shared by threads; to stop
+// on the precision of a combined parallel estimate, use it with
+// monte_carlo_parallel_reduced() (see executor-utils.hxx).
+//
+// samples_saved(fixed_count, tally) reports how many fewer samples were
+// used than a fixed-count run of fixed_count samples.
+//
+class stop_at_precision_controller
+{
+public:
+  using size_type = std::size_t;
+
+  static constexpr double z_95 = 1.959963984540054;
+
+private:
+  double half_width_;
+  double z_;
+  double scale_;
+  size_type min_count_;
+  double growth_;
+  std::atomic<size_type> next_check_;
+  std::atomic<size_type> checks_;
+  std::atomic<size_type> stop_count_;
+  std::atomic<bool> run_;
+
+  template <typename Tally, typename = void>
+  struct is_bernoulli_tally : std::false_type { };
+
+  template <typename Tally>
+  struct is_bernoulli_tally<
+    Tally, std::void_t<decltype(std::declval<Tally const&>().true_count())>
+  > : std::true_type { };
+
+  bool check(size_type const count, double const hw) noexcept
+  {
+    checks_.fetch_add(1, std::memory_order_relaxed);
+    if (hw <= half_width_)
+    {
+      stop_count_.store(count, std::memory_order_relaxed);
+      run_.store(false, std::memory_order_relaxed);
+      return false;
+    }
+
+    // check again at the predicted count, but at most growth times later...
+    double const r = hw / half_width_;
+    auto const next = std::max<size_type>(
+      count + 1, std::min(count * growth_, count * r * r)
+    );
+    next_check_.store(next, std::memory_order_relaxed);
+    return run_.load(std::memory_order_relaxed);
+  }
+
+public:
+  stop_at_precision_controller() = delete;
+  stop_at_precision_controller(
+    double const half_width,
+    double const scale = 1.0,
+    double const z = z_95,
+    size_type const min_count = 1000,
+    double const growth = 1.25
+  ) :
+    half_width_{half_width},
+    z_{z},
+    scale_{scale},
+    min_count_{std::max<size_type>(min_count, 2)},
+    growth_{std::max(growth, 1.0)},
+    next_check_{min_count_},
+    checks_{},
+    stop_count_{},
+    run_{true}
+  {
+  }
+  stop_at_precision_controller(stop_at_precision_controller const&) = delete;
+  stop_at_precision_controller& operator =(
+    stop_at_precision_controller const&) = delete;
+
+  template <typename Tally>
+  double standard_error(Tally const& tally) const
+  {
+    double const n = tally.count();
+    if constexpr(is_bernoulli_tally<Tally>::value)
+    {
+      double const m = n + z_ * z_;
+      double const p = (tally.true_count() + z_ * z_ / 2) / m;
+      return std::sqrt(p * (1 - p) / m);
+    }
+    else
+    {
+      double const v = tally.variance();
+      return v > 0 ? std::sqrt(v / n) : std::numeric_limits<double>::infinity();
+    }
+  }
+
+  // return the current confidence interval half-width of tally...
+  template <typename Tally>
+  double half_width(Tally const& tally) const
+  {
+    return z_ * scale_ * standard_error(tally);
+  }
+
+  // return the estimated count needed to reach the target half-width...
+  template <typename Tally>
+  size_type required_count(Tally const& tally) const
+  {
+    double const r = half_width(tally) / half_width_;
+    double const required = std::ceil(tally.count() * r * r);
+    return required < double(std::numeric_limits<size_type>::max())
+      ? size_type(required) : std::numeric_limits<size_type>::max();
+  }
+
+  double target_half_width() const noexcept
+  {
+    return half_width_;
+  }
+
+  size_type checks() const noexcept
+  {
+    return checks_.load(std::memory_order_relaxed);
+  }
+
+  bool reached() const noexcept
+  {
+    return stop_count_.load(std::memory_order_relaxed) != 0;
+  }
+
+  // return the count at which the target precision was reached (or 0)...
+  size_type stop_count() const noexcept
+  {
+    return stop_count_.load(std::memory_order_relaxed);
+  }
+
+  // return how many fewer samples tally used than a fixed-count run...
+  template <typename Tally>
+  size_type samples_saved(
+    size_type const fixed_count, Tally const& tally
+  ) const
+  {
+    return fixed_count - std::min<size_type>(fixed_count, tally.count());
+  }
+
+  void stop() noexcept
+  {
+    run_.store(false, std::memory_order_relaxed);
+  }
+
+  // return false once the target precision has been reached...
+  template <typename Tally>
+  bool operator ()(Tally const& tally)
+  {
+    size_type const count = tally.count();
+    if (count < next_check_.load(std::memory_order_relaxed))
+      return run_.load(std::memory_order_relaxed);
+    return check(count, half_width(tally));
+  }
+
+  // batched form: the checkpoint test does not depend on the block size...
+  template <typename Tally>
+  bool operator ()(Tally const& tally, size_type const)
+  {
+    return (*this)(tally);
+  }
+};
+
+//===========================================================================
+
 #endif // #ifndef controller_hxx_
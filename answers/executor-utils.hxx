@@ -0,0 +1,646 @@
+// Brejvinder
+#ifndef executor_utils_hxx_
+#define executor_utils_hxx_
+
+//===========================================================================
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "cache-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+//===========================================================================
+
+//
+// work_stealing_executor
+// class
+//
+// A persistent pool of worker threads (one per hardware thread by default).
+// Each worker owns a task deque: it runs tasks from the back of its own
+// deque and, when that is empty, steals tasks from the front of the other
+// workers' deques. Each deque has its own (normally uncontended) mutex.
+//
+// Tasks are passed the index of the worker running them so that they can
+// use per-worker state without any further synchronization.
+//
+// The executor can be reused for any number of runs. wait() blocks until
+// every submitted task (including tasks submitted by tasks) has finished
+// and rethrows the first exception thrown by a task, if any.
+//
+// NOTE: wait() must not be called from within a task.
+//
+class work_stealing_executor
+{
+public:
+  using size_type = std::size_t;
+  using task_type = std::function<void(size_type)>;
+
+private:
+  struct alignas(cache_line_size) worker_queue
+  {
+    std::mutex mutex;
+    std::deque<task_type> tasks;
+  };
+
+  size_type nworkers_;
+  std::unique_ptr<worker_queue[]> queues_;
+  std::vector<std::thread> threads_;
+
+  std::atomic<size_type> queued_;
+  std::atomic<size_type> unfinished_;
+
+  std::mutex idle_mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stop_;
+  std::exception_ptr error_;
+
+  bool try_pop(size_type const w, task_type& task)
+  {
+    std::lock_guard<std::mutex> guard(queues_[w].mutex);
+    if (queues_[w].tasks.empty())
+      return false;
+    task = std::move(queues_[w].tasks.back());
+    queues_[w].tasks.pop_back();
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool try_steal(size_type const w, task_type& task)
+  {
+    for (size_type i = 1; i != nworkers_; ++i)
+    {
+      auto& q = queues_[(w + i) % nworkers_];
+      std::lock_guard<std::mutex> guard(q.mutex);
+      if (q.tasks.empty())
+        continue;
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  void run(task_type& task, size_type const w)
+  {
+    try
+    {
+      task(w);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> guard(idle_mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+
+    if (unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      std::lock_guard<std::mutex> guard(idle_mutex_);
+      done_cv_.notify_all();
+    }
+  }
+
+  void worker_loop(size_type const w)
+  {
+    task_type task;
+    for (;;)
+    {
+      if (try_pop(w, task) || try_steal(w, task))
+      {
+        run(task, w);
+        task = nullptr;
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      work_cv_.wait(lock, [this]() {
+        return stop_ || queued_.load(std::memory_order_relaxed) != 0;
+      });
+      if (stop_ && queued_.load(std::memory_order_relaxed) == 0)
+        return;
+    }
+  }
+
+public:
+  explicit work_stealing_executor(
+    size_type const nworkers = std::thread::hardware_concurrency()
+  ) :
+    nworkers_{std::max<size_type>(nworkers, 1)},
+    queues_{new worker_queue[nworkers_]},
+    queued_{},
+    unfinished_{},
+    stop_{false}
+  {
+    threads_.reserve(nworkers_);
+    for (size_type w = 0; w != nworkers_; ++w)
+      threads_.emplace_back([this, w]() { worker_loop(w); });
+  }
+
+  work_stealing_executor(work_stealing_executor const&) = delete;
+  work_stealing_executor& operator =(work_stealing_executor const&) = delete;
+
+  ~work_stealing_executor()
+  {
+    {
+      std::lock_guard<std::mutex> guard(idle_mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : threads_)
+      t.join();
+  }
+
+  size_type size() const noexcept
+  {
+    return nworkers_;
+  }
+
+  // queue task on worker (hint % size())'s deque...
+  void submit(task_type task, size_type const hint = 0)
+  {
+    unfinished_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> guard(idle_mutex_);
+      queued_.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+      auto& q = queues_[hint % nworkers_];
+      std::lock_guard<std::mutex> guard(q.mutex);
+      q.tasks.push_back(std::move(task));
+    }
+    work_cv_.notify_one();
+  }
+
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    done_cv_.wait(lock, [this]() {
+      return unfinished_.load(std::memory_order_acquire) == 0;
+    });
+    if (error_)
+      std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+
+  //
+  // Runs fn(i, worker) for every i in [0,n) and waits for all of them to
+  // finish. Index i is initially queued on worker i % size().
+  //
+  template <typename Fn>
+  void run_indexed(size_type const n, Fn fn)
+  {
+    for (size_type i = 0; i != n; ++i)
+      submit([&fn, i](size_type w) { fn(i, w); }, i);
+    wait();
+  }
+};
+
+//===========================================================================
+
+namespace monte_carlo_detail {
+
+template <typename Tally, typename = void>
+struct has_bind_worker : std::false_type { };
+
+template <typename Tally>
+struct has_bind_worker<
+  Tally,
+  std::void_t<decltype(std::declval<Tally&>().bind_worker(std::size_t{}))>
+> : std::true_type { };
+
+//
+// Tells a stream's tally which worker is about to run it, if the tally has
+// a bind_worker(w) member (e.g., telemetry_tally publishes to that
+// worker's slot)...
+//
+template <typename Tally>
+inline void bind_worker(Tally& tally, std::size_t const w)
+{
+  if constexpr(has_bind_worker<Tally>::value)
+    tally.bind_worker(w);
+}
+
+inline void check_chunk_size(std::size_t const chunk_size)
+{
+  if (chunk_size == 0)
+    throw std::invalid_argument("chunk_size must be positive");
+}
+
+//
+// Controls one chunk of a parallel run: stops after limit samples have been
+// tallied or when the wrapped controller stops --and records the latter.
+//
+template <typename Controller>
+class chunk_controller
+{
+private:
+  Controller* c_;
+  std::size_t limit_;
+  bool stopped_;
+
+public:
+  chunk_controller(Controller& c, std::size_t const limit) noexcept :
+    c_{&c},
+    limit_{limit},
+    stopped_{false}
+  {
+  }
+
+  bool stopped() const noexcept
+  {
+    return stopped_;
+  }
+
+  template <typename Tally>
+  std::size_t remaining(Tally const& tally)
+  {
+    std::size_t const n = tally.count() < limit_ ? limit_ - tally.count() : 0;
+    if constexpr(has_remaining<Controller, Tally>::value)
+    {
+      std::size_t const m = c_->remaining(tally);
+      stopped_ = stopped_ || m == 0;
+      return std::min(n, m);
+    }
+    else
+      return n;
+  }
+
+  template <typename Tally>
+  bool operator ()(Tally const& tally, std::size_t const n)
+  {
+    stopped_ = !control_block(*c_, tally, n);
+    return !stopped_ && tally.count() < limit_;
+  }
+};
+
+} // namespace monte_carlo_detail
+
+//===========================================================================
+
+inline constexpr std::size_t default_monte_carlo_chunk_size = 1 << 16;
+
+//
+// monte_carlo_parallel<Tally>(ex, c, op, chunk_size)
+// function
+//
+// Runs ex.size() Monte Carlo "streams" on the workers of ex until
+// controller c stops. Each stream tallies into its own cache-padded Tally
+// and c is evaluated against that stream's tally, i.e., like the
+// per-invocation tallies of monte-carlo-pi-parstl-timed.cxx, a
+// stop_after_count_controller(n) runs n samples per stream. Streams run in
+// chunks of chunk_size samples using monte_carlo_tally_batched() and each
+// chunk is a task, so a stream can move to an idle worker between chunks.
+// The stream tallies are combined with Tally::operator += at the end.
+//
+// Each stream's tally starts as a copy of prototype and is passed to
+// bind_worker(w) before each chunk (see telemetry_tally). The other
+// drivers below take a prototype in the same way.
+//
+// c and op are shared by all workers so they must be safe to call
+// concurrently (e.g., op uses thread_local engines).
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Controller,
+  typename Op
+>
+Tally monte_carlo_parallel(
+  work_stealing_executor& ex,
+  Controller&& c,
+  Op op,
+  std::size_t const chunk_size = default_monte_carlo_chunk_size,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using controller_type = std::remove_reference_t<Controller>;
+  using size_type = work_stealing_executor::size_type;
+
+  check_chunk_size(chunk_size);
+  std::vector<cache_padded<Tally>> tallies(ex.size(), { prototype });
+  std::vector<work_stealing_executor::task_type> streams(ex.size());
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    streams[k] = [&, k](size_type w) {
+      Tally& tally = tallies[k].value;
+      bind_worker(tally, w);
+      chunk_controller<controller_type> cc(c, tally.count() + chunk_size);
+      monte_carlo_tally_batched<Sample, BlockSize>(cc, tally, op);
+      if (!cc.stopped())
+        ex.submit(streams[k], k);
+    };
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    ex.submit(streams[k], k);
+  ex.wait();
+
+  Tally total;
+  for (auto const& t : tallies)
+    total += t.value;
+  return total;
+}
+
+//
+// monte_carlo_parallel_n<Tally>(ex, n, op, chunk_size)
+// function
+//
+// Runs exactly n samples of op split into chunks of chunk_size samples
+// which are spread over the workers of ex. Returns the combined tally.
+// Throws std::invalid_argument if chunk_size is 0 (as do the other drivers
+// below).
+//
+// Chunks are handed out on demand: ex.size() tasks each take the next
+// chunk number from a shared counter, run that chunk and requeue
+// themselves, so only O(ex.size()) tasks and tallies exist at any time no
+// matter how large n is (and an idle worker can still steal a requeued
+// task from a busy one). Each chunk runs in the counted block loop of
+// monte_carlo_tally_batched(). monte_carlo_parallel_split() below splits n
+// up front instead.
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Op
+>
+Tally monte_carlo_parallel_n(
+  work_stealing_executor& ex,
+  std::size_t const n,
+  Op op,
+  std::size_t const chunk_size = default_monte_carlo_chunk_size,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using size_type = work_stealing_executor::size_type;
+
+  check_chunk_size(chunk_size);
+  size_type const nchunks = (n + chunk_size - 1) / chunk_size;
+  std::vector<cache_padded<Tally>> tallies(ex.size(), { prototype });
+  std::atomic<size_type> next{0};
+  std::vector<work_stealing_executor::task_type> streams(ex.size());
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    streams[k] = [&, k](size_type w) {
+      size_type const i = next.fetch_add(1, std::memory_order_relaxed);
+      if (i >= nchunks)
+        return;
+
+      Tally& tally = tallies[w].value;
+      bind_worker(tally, w);
+      size_type const len = std::min(chunk_size, n - i * chunk_size);
+      monte_carlo_tally_batched<Sample, BlockSize>(
+        stop_after_count_controller(tally.count() + len), tally, op
+      );
+      ex.submit(streams[k], k);
+    };
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    ex.submit(streams[k], k);
+  ex.wait();
+
+  Tally total;
+  for (auto const& t : tallies)
+    total += t.value;
+  return total;
+}
+
+//
+// monte_carlo_parallel_split<Tally>(ex, c, op)
+// function
+//
+// Runs c.count() samples of op for a count-only controller c (see
+// "Specialized kernels" in monte-carlo-utils.hxx) by splitting the count
+// evenly over the workers of ex up front: ex.size() tasks each run
+// c.count() / ex.size() samples (plus one for the first c.count() %
+// ex.size() tasks) in the counted block loop of
+// monte_carlo_tally_batched(). Unlike monte_carlo_parallel_n() there is no
+// shared chunk counter and no task is requeued, so nothing is shared
+// between the workers while they run. It suits workers that run at the
+// same speed --there are no chunks left for an idle worker to steal.
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Controller,
+  typename Op
+>
+Tally monte_carlo_parallel_split(
+  work_stealing_executor& ex,
+  Controller&& c,
+  Op op,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using size_type = work_stealing_executor::size_type;
+
+  static_assert(
+    is_count_controller<controller_t<Controller>>::value,
+    "monte_carlo_parallel_split() requires a count-only controller"
+  );
+
+  size_type const n = c.count();
+  size_type const nworkers = ex.size();
+  std::vector<cache_padded<Tally>> tallies(nworkers, { prototype });
+
+  ex.run_indexed(nworkers, [&](size_type i, size_type w) {
+    Tally& tally = tallies[i].value;
+    bind_worker(tally, w);
+    size_type const len = n / nworkers + (i < n % nworkers);
+    monte_carlo_tally_batched<Sample, BlockSize>(
+      stop_after_count_controller(tally.count() + len), tally, op
+    );
+  });
+
+  Tally total;
+  for (auto const& t : tallies)
+    total += t.value;
+  return total;
+}
+
+//
+// monte_carlo_parallel_reduced<Tally>(ex, c, op, chunk_size)
+// function
+//
+// Like monte_carlo_parallel() except that controller c is evaluated against
+// the combined tally of all streams. Each stream tallies chunks of
+// chunk_size samples into a local Tally and then, under a mutex, merges it
+// into the combined tally and evaluates c on the result. Once c returns
+// false no further chunks are started, so the run may overshoot by less
+// than one chunk per stream. Since c is only called under the mutex it
+// need not be thread-safe.
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Controller,
+  typename Op
+>
+Tally monte_carlo_parallel_reduced(
+  work_stealing_executor& ex,
+  Controller&& c,
+  Op op,
+  std::size_t const chunk_size = default_monte_carlo_chunk_size,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using size_type = work_stealing_executor::size_type;
+
+  check_chunk_size(chunk_size);
+  Tally total;
+  std::mutex total_mutex;
+  std::atomic<bool> run{true};
+  std::vector<work_stealing_executor::task_type> streams(ex.size());
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    streams[k] = [&, k](size_type w) {
+      Tally tally(prototype);
+      bind_worker(tally, w);
+      never_stop_controller never;
+      chunk_controller<never_stop_controller> cc(never, chunk_size);
+      monte_carlo_tally_batched<Sample, BlockSize>(cc, tally, op);
+
+      {
+        std::lock_guard<std::mutex> guard(total_mutex);
+        total += tally;
+        if (!c(std::as_const(total)))
+          run.store(false, std::memory_order_relaxed);
+      }
+
+      if (run.load(std::memory_order_relaxed))
+        ex.submit(streams[k], k);
+    };
+
+  for (size_type k = 0; k != streams.size(); ++k)
+    ex.submit(streams[k], k);
+  ex.wait();
+
+  return total;
+}
+
+//
+// monte_carlo_parallel_streams<Tally>(ex, streams, n, make_op, chunk_size)
+// function
+//
+// Runs exactly n samples split into chunks of chunk_size samples. Chunk k
+// draws its random numbers from its own engine, streams.stream(k) (see
+// random_stream_factory), through the op returned by make_op(engine). The
+// chunk tallies are combined in chunk order, so the result is
+// bit-identical for any number of workers and any scheduling order --even
+// for floating-point tallies such as tally_mean_variance.
+//
+// As in monte_carlo_parallel_n(), ex.size() tasks take chunks on demand.
+// A finished chunk's tally waits in a ring of window slots (4 * ex.size()
+// by default) until all earlier chunks are merged; a task that finds the
+// ring full (because the oldest unmerged chunk is still running) parks
+// until that chunk is merged. So memory use is O(window), not O(n /
+// chunk_size).
+//
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename StreamFactory,
+  typename MakeOp
+>
+Tally monte_carlo_parallel_streams(
+  work_stealing_executor& ex,
+  StreamFactory const& streams,
+  std::size_t const n,
+  MakeOp make_op,
+  std::size_t const chunk_size = default_monte_carlo_chunk_size,
+  std::size_t const window = 0,
+  Tally const& prototype = Tally()
+)
+{
+  using namespace monte_carlo_detail;
+  using size_type = work_stealing_executor::size_type;
+
+  struct slot
+  {
+    Tally tally;
+    bool ready = false;
+  };
+
+  check_chunk_size(chunk_size);
+  size_type const nchunks = (n + chunk_size - 1) / chunk_size;
+  size_type const nslots = window != 0 ? window : 4 * ex.size();
+
+  Tally total;
+  std::mutex mutex;
+  std::vector<slot> slots(nslots);
+  size_type next = 0;                   // the next chunk to start
+  size_type merged = 0;                 // chunks merged into total
+  size_type parked = 0;                 // tasks waiting for a free slot
+  work_stealing_executor::task_type stream;
+
+  stream = [&](size_type w) {
+    size_type i;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (next == nchunks)
+        return;
+      if (next == merged + nslots)
+      {
+        ++parked;
+        return;
+      }
+      i = next++;
+    }
+
+    Tally tally(prototype);
+    bind_worker(tally, w);
+    auto engine = streams.stream(i);
+    auto op = make_op(engine);
+    size_type const len = std::min(chunk_size, n - i * chunk_size);
+    never_stop_controller never;
+    chunk_controller<never_stop_controller> cc(never, len);
+    monte_carlo_tally_batched<Sample, BlockSize>(cc, tally, op);
+
+    size_type resume;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      slots[i % nslots] = { std::move(tally), true };
+      // merge the finished chunks that follow the merged ones in order...
+      while (merged != nchunks && slots[merged % nslots].ready)
+      {
+        total += slots[merged % nslots].tally;
+        slots[merged % nslots].ready = false;
+        ++merged;
+      }
+      resume = std::exchange(parked, 0) + 1;
+    }
+    while (resume-- != 0)
+      ex.submit(stream, w);
+  };
+
+  for (size_type k = 0; k != ex.size(); ++k)
+    ex.submit(stream, k);
+  ex.wait();
+
+  return total;
+}
+
+//===========================================================================
+
+#endif // #ifndef executor_utils_hxx_
@@ -0,0 +1,400 @@
+// Brejvinder
+#ifndef monte_carlo_batch_utils_hxx_
+#define monte_carlo_batch_utils_hxx_
+
+//===========================================================================
+
+#include <map>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "cache-utils.hxx"
+#include "random-utils.hxx"
+#include "executor-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+//===========================================================================
+
+struct monte_carlo_batch_timing
+{
+  std::string name;
+  std::size_t dimension;
+  std::size_t samples;
+  std::size_t rounds;         // rounds the job took part in
+  double busy_seconds;        // summed over workers (excludes RNG time)
+  double finish_seconds;      // since run() started
+};
+
+template <typename Tally>
+struct monte_carlo_batch_handle
+{
+  std::size_t index;
+};
+
+//===========================================================================
+
+namespace monte_carlo_detail {
+
+//
+// A job of a monte_carlo_batch with its type erased. In each round, each
+// of the batch's slices calls run_lane() (with the slice's lane number)
+// on the slice's points, and then end_round() merges the lanes in lane
+// order and consults the controller.
+//
+class batch_job_base
+{
+public:
+  using size_type = std::size_t;
+  using clock_type = std::chrono::steady_clock;
+
+  monte_carlo_batch_timing timing;
+  bool finished = false;
+
+  virtual ~batch_job_base() = default;
+
+  // the number of samples the job may still take this round...
+  virtual size_type quota() = 0;
+
+  virtual void run_lane(
+    size_type lane, double const* points, size_type npoints
+  ) = 0;
+
+  // returns false once the job is done...
+  virtual bool end_round(size_type nsamples) = 0;
+};
+
+template <typename Tally>
+class batch_tally_job : public batch_job_base
+{
+protected:
+  Tally total_{};
+
+public:
+  Tally const& tally() const noexcept
+  {
+    return total_;
+  }
+};
+
+template <
+  typename Tally,
+  typename Controller,
+  typename Op,
+  std::size_t BlockSize = default_monte_carlo_block_size
+>
+class batch_job final : public batch_tally_job<Tally>
+{
+public:
+  using size_type = batch_job_base::size_type;
+  using clock_type = batch_job_base::clock_type;
+  using sample_type = std::decay_t<std::invoke_result_t<Op&, double const*>>;
+
+private:
+  struct lane
+  {
+    Tally tally;
+    double seconds;
+  };
+
+  Controller c_;
+  Op op_;
+  Tally prototype_;
+  std::vector<cache_padded<lane>> lanes_;
+
+  void reset_lane(size_type const l)
+  {
+    lanes_[l].value.tally = prototype_;
+    bind_worker(lanes_[l].value.tally, l);
+  }
+
+  using batch_tally_job<Tally>::total_;
+
+public:
+  batch_job(
+    std::string name, size_type const dimension, size_type const nlanes,
+    Controller&& c, Op op, Tally const& prototype
+  ) :
+    c_{std::forward<Controller>(c)},
+    op_{std::move(op)},
+    prototype_{prototype},
+    lanes_(nlanes)
+  {
+    this->timing = { std::move(name), dimension, 0, 0, 0, 0 };
+    for (size_type l = 0; l != nlanes; ++l)
+      reset_lane(l);
+  }
+
+  size_type quota() override
+  {
+    if constexpr(has_remaining<Controller, Tally>::value)
+      return c_.remaining(total_);
+    else
+      return std::numeric_limits<size_type>::max();
+  }
+
+  void run_lane(
+    size_type const l, double const* points, size_type const npoints
+  ) override
+  {
+    auto const start = clock_type::now();
+    size_type const d = this->timing.dimension;
+    lane& ln = lanes_[l].value;
+
+    std::array<sample_type, BlockSize> block;
+    for (size_type i = 0; i != npoints; )
+    {
+      size_type const n = std::min(BlockSize, npoints - i);
+      for (size_type j = 0; j != n; ++j, ++i)
+        block[j] = op_(points + i * d);
+      tally_block<Tally, sample_type>(ln.tally, block.data(), block.data() + n);
+    }
+
+    ln.seconds += std::chrono::duration<double>(clock_type::now() - start).count();
+  }
+
+  bool end_round(size_type const nsamples) override
+  {
+    for (size_type l = 0; l != lanes_.size(); ++l)
+    {
+      total_ += lanes_[l].value.tally;
+      reset_lane(l);
+      this->timing.busy_seconds +=
+        std::exchange(lanes_[l].value.seconds, 0.0);
+    }
+    this->timing.samples = total_.count();
+    ++this->timing.rounds;
+    return control_block(c_, std::as_const(total_), nsamples);
+  }
+};
+
+} // namespace monte_carlo_detail
+
+//===========================================================================
+
+//
+// monte_carlo_batch
+// class
+//
+// Runs many independent Monte Carlo estimators ("jobs") together on one
+// work_stealing_executor. A job is a tally, a controller and an op that
+// maps a point of the d-dimensional unit cube [0,1)^d (passed as a pointer
+// to d doubles) to a sample, e.g., a predicate for area estimates:
+//
+//   monte_carlo_batch batch(2019);
+//   auto h = batch.add<tally_predicate>("pi", 2,
+//     stop_after_count_controller(1'000'000),
+//     [](double const* p) { return p[0] * p[0] + p[1] * p[1] <= 1; }
+//   );
+//   auto timings = batch.run(ex);
+//   batch.tally(h).true_count();
+//
+// Jobs are scheduled in rounds for fair time-slicing. In each round every
+// unfinished job gets up to slices_per_round slices of slice_size points
+// (the slices are tasks spread over the workers), and afterwards each
+// job's controller is evaluated against its combined tally. So short jobs
+// finish after a few rounds no matter how many long jobs there are.
+// Controllers with remaining(), such as stop_after_count_controller, stop
+// exactly.
+//
+// All jobs of the same dimension d share the random points: each slice is
+// generated once, from philox4x32 stream d (see random_stream_factory),
+// and passed to all of them. No per-job engines or threads are created.
+// Each slice tallies into its own lane of a job and lanes are merged in
+// order, so the results only depend on the seed, slices_per_round and
+// slice_size --not on the number of workers.
+//
+// Ops are called concurrently from several workers so they must be safe to
+// call concurrently (e.g., pure functions). Controllers are only called
+// between rounds. A controller passed to add() as an rvalue is moved into
+// the batch, an lvalue (e.g., a stop_at_precision_controller, which cannot
+// be moved) is referred to and must outlive run().
+//
+// add() optionally takes a prototype tally: each lane's tally starts as a
+// copy of it and is passed to bind_worker(lane) (see telemetry_tally and
+// monte_carlo_parallel()), so a telemetry_monitor of slices_per_round
+// slots gets one slot per lane.
+//
+class monte_carlo_batch
+{
+public:
+  using size_type = std::size_t;
+  using clock_type = std::chrono::steady_clock;
+
+  static constexpr size_type default_slice_size = 4096;
+
+private:
+  using job_base = monte_carlo_detail::batch_job_base;
+
+  random_stream_factory<philox4x32> streams_;
+  size_type slices_per_round_;
+  std::vector<std::unique_ptr<job_base>> jobs_;
+  std::map<size_type, std::uint64_t> next_slice_;   // per dimension
+
+public:
+  explicit monte_carlo_batch(
+    std::uint64_t const seed,
+    size_type const slices_per_round =
+      std::max(1U, std::thread::hardware_concurrency())
+  ) :
+    streams_{seed},
+    slices_per_round_{std::max<size_type>(slices_per_round, 1)}
+  {
+  }
+
+  size_type size() const noexcept
+  {
+    return jobs_.size();
+  }
+
+  template <
+    typename Tally,
+    std::size_t BlockSize = default_monte_carlo_block_size,
+    typename Controller,
+    typename Op
+  >
+  monte_carlo_batch_handle<Tally> add(
+    std::string name, size_type const dimension, Controller&& c, Op op,
+    Tally const& prototype = Tally()
+  )
+  {
+    using job_type =
+      monte_carlo_detail::batch_job<Tally, Controller, Op, BlockSize>;
+
+    if (dimension == 0)
+      throw std::invalid_argument("monte_carlo_batch: dimension must be > 0");
+
+    jobs_.push_back(std::make_unique<job_type>(
+      std::move(name), dimension, slices_per_round_,
+      std::forward<Controller>(c), std::move(op), prototype
+    ));
+    return { jobs_.size() - 1 };
+  }
+
+  template <typename Tally>
+  Tally const& tally(monte_carlo_batch_handle<Tally> const& h) const
+  {
+    return static_cast<
+      monte_carlo_detail::batch_tally_job<Tally> const&
+    >(*jobs_.at(h.index)).tally();
+  }
+
+  //
+  // Runs all jobs until their controllers stop and returns their timings
+  // in the order the jobs were added. Running again after adding more jobs
+  // runs the new jobs and continues each dimension's random stream.
+  //
+  std::vector<monte_carlo_batch_timing> run(
+    work_stealing_executor& ex,
+    size_type const slice_size = default_slice_size
+  )
+  {
+    struct planned_job
+    {
+      job_base* job;
+      size_type quota;
+    };
+
+    struct group
+    {
+      std::uint64_t first_slice;
+      std::vector<job_base*> active;
+      std::vector<planned_job> planned;
+    };
+
+    auto const start = clock_type::now();
+    size_type const nslices = slices_per_round_;
+
+    std::map<size_type, group> groups;
+    for (auto& j : jobs_)
+      if (!j->finished)
+      {
+        groups[j->timing.dimension].active.push_back(j.get());
+        next_slice_[j->timing.dimension];
+      }
+
+    std::vector<std::pair<size_type const, group>*> round;
+    for (;;)
+    {
+      round.clear();
+      for (auto& g : groups)
+      {
+        if (g.second.active.empty())
+          continue;
+        g.second.first_slice = next_slice_[g.first];
+        g.second.planned.clear();
+        for (auto* j : g.second.active)
+          g.second.planned.push_back({ j, j->quota() });
+        round.push_back(&g);
+      }
+      if (round.empty())
+        break;
+
+      ex.run_indexed(round.size() * nslices, [&](size_type i, size_type) {
+        size_type const d = round[i / nslices]->first;
+        group& g = round[i / nslices]->second;
+        size_type const l = i % nslices;
+
+        // this slice's points for each job: [0,S) less what it has left...
+        auto const npoints = [&](planned_job const& p) {
+          size_type const used = l * slice_size;
+          return p.quota > used ? std::min(slice_size, p.quota - used) : 0;
+        };
+
+        size_type n = 0;
+        for (auto const& p : g.planned)
+          n = std::max(n, npoints(p));
+        if (n == 0)
+          return;
+
+        static thread_local std::vector<double> points;
+        points.resize(n * d);
+        auto engine = streams_.stream(d);
+        engine.discard((g.first_slice + l) * slice_size * d);
+        engine.generate(points.data(), points.data() + n * d);
+
+        for (auto const& p : g.planned)
+          if (size_type const m = npoints(p); m != 0)
+            p.job->run_lane(l, points.data(), m);
+      });
+
+      double const now =
+        std::chrono::duration<double>(clock_type::now() - start).count();
+      for (auto* g : round)
+      {
+        auto& active = g->second.active;
+        active.clear();
+        for (auto const& p : g->second.planned)
+        {
+          size_type const n = std::min(p.quota, nslices * slice_size);
+          if (p.job->end_round(n))
+            active.push_back(p.job);
+          else
+          {
+            p.job->finished = true;
+            p.job->timing.finish_seconds = now;
+          }
+        }
+        next_slice_[g->first] += nslices;
+      }
+    }
+
+    std::vector<monte_carlo_batch_timing> timings;
+    for (auto const& j : jobs_)
+      timings.push_back(j->timing);
+    return timings;
+  }
+};
+
+//===========================================================================
+
+#endif // #ifndef monte_carlo_batch_utils_hxx_
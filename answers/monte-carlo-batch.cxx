@@ -0,0 +1,165 @@
+// Brejvinder
+#include <cmath>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+#include "monte-carlo-batch-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+//
+// The fraction of [0,1)^d within distance r of the origin (r <= 1), i.e.,
+// the volume of a d-ball of radius r over 2**d...
+//
+double exact_fraction(size_t d, double r) {
+  return pow(M_PI, d / 2.0) / tgamma(d / 2.0 + 1) * pow(r / 2, d);
+}
+
+struct in_ball {
+  size_t d;
+  double r2;
+
+  bool operator ()(double const* p) const {
+    double s = 0;
+    for (size_t i = 0; i != d; ++i)
+      s += p[i] * p[i];
+    return s <= r2;
+  }
+};
+
+//
+// Usage: monte-carlo-batch.exe [samples-per-job]
+//
+// Estimates 200 small "area" integrals (d-ball fractions for d = 2..5 and
+// 50 radii each) three ways: one job after another each on its own thread
+// and engine (like the monte-carlo-pi-*.cxx programs), all jobs as tasks on
+// one pool each with its own engine, and as one monte_carlo_batch. Then
+// adds two precision-controlled estimates of pi to the batch and runs it
+// again.
+//
+int main(int argc, char* argv[]) {
+  using namespace std;
+  using clock_type = chrono::steady_clock;
+
+  size_t const n = argc > 1 ? stoul(argv[1]) : 200'000;
+  size_t const nradii = 50;
+
+  struct job {
+    string name;
+    size_t d;
+    double r;
+  };
+  vector<job> jobs;
+  for (size_t d = 2; d <= 5; ++d)
+    for (size_t k = 1; k <= nradii; ++k)
+      jobs.push_back({
+        "d" + to_string(d) + "-r" + to_string(k), d, double(k) / nradii
+      });
+
+  work_stealing_executor ex;
+  benchmark<clock_type> bm;
+
+  // a job as a standalone estimator with its own engine...
+  auto run_alone = [&](job const& j) {
+    auto engine = make_randomly_seeded_random_stream_factory<>().stream(0);
+    in_ball const pred{j.d, j.r * j.r};
+    return monte_carlo_batched<tally_predicate>(
+      stop_after_count_controller(n),
+      [&]() {
+        double p[8];
+        engine.generate(p, p + j.d);
+        return pred(p);
+      }
+    );
+  };
+
+  bm.start();
+  for (auto const& j : jobs)
+    async(launch::async, run_alone, cref(j)).get();
+  bm.stop();
+  double const separate = duration_convert<double>(bm.duration()).count();
+
+  bm.start();
+  ex.run_indexed(jobs.size(), [&](size_t i, size_t) { run_alone(jobs[i]); });
+  bm.stop();
+  double const pooled = duration_convert<double>(bm.duration()).count();
+
+  //
+  // The batch...
+  //
+  monte_carlo_batch batch(2019);
+  vector<monte_carlo_batch_handle<tally_predicate>> handles;
+  for (auto const& j : jobs)
+    handles.push_back(batch.add<tally_predicate>(
+      j.name, j.d, stop_after_count_controller(n), in_ball{j.d, j.r * j.r}
+    ));
+
+  bm.start();
+  auto timings = batch.run(ex);
+  bm.stop();
+  double const batched = duration_convert<double>(bm.duration()).count();
+
+  // check the estimates against the exact fractions...
+  double max_z = 0;
+  for (size_t i = 0; i != jobs.size(); ++i) {
+    auto const& t = batch.tally(handles[i]);
+    double const p = exact_fraction(jobs[i].d, jobs[i].r);
+    double const phat = double(t.true_count()) / t.count();
+    double const se = sqrt(p * (1 - p) / t.count());
+    if (se > 0)
+      max_z = max(max_z, abs(phat - p) / se);
+  }
+
+  cout
+      << setprecision(4)
+      << jobs.size() << " jobs of " << n << " samples:\n"
+      << "  one after another: " << separate << "s\n"
+      << "  pool, own engines: " << pooled << "s\n"
+      << "  monte_carlo_batch: " << batched << "s\n"
+      << "  max |z| of the batch estimates: " << max_z << "\n\n";
+
+  // more jobs can be added to the batch and run...
+  stop_at_precision_controller pi_3(1e-3, 4), pi_4(5e-4, 4);
+  auto const h3 = batch.add<tally_predicate>("pi-1e-3", 2, pi_3, in_ball{2, 1});
+  auto const h4 = batch.add<tally_predicate>("pi-5e-4", 2, pi_4, in_ball{2, 1});
+  timings = batch.run(ex);
+
+  cout
+      << setw(10) << "job"
+      << setw(5) << "d"
+      << setw(12) << "samples"
+      << setw(8) << "rounds"
+      << setw(12) << "busy (s)"
+      << setw(12) << "done at (s)"
+      << setw(20) << "estimate" << '\n';
+  auto print = [&](monte_carlo_batch_timing const& t, double estimate) {
+    cout
+        << setw(10) << t.name
+        << setw(5) << t.dimension
+        << setw(12) << t.samples
+        << setw(8) << t.rounds
+        << setw(12) << setprecision(4) << t.busy_seconds
+        << setw(12) << setprecision(4) << t.finish_seconds
+        << setw(20) << setprecision(12) << estimate << '\n';
+  };
+  for (size_t i : { size_t(0), size_t(nradii - 1), jobs.size() - 1 })
+    print(
+      timings[i],
+      double(batch.tally(handles[i]).true_count()) / batch.tally(handles[i]).count()
+    );
+  print(timings[h3.index], 4.0 * batch.tally(h3).true_count() / batch.tally(h3).count());
+  print(timings[h4.index], 4.0 * batch.tally(h4).true_count() / batch.tally(h4).count());
+
+  return max_z < 5 ? 0 : 1;
+}
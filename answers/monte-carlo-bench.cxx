@@ -0,0 +1,290 @@
+// Brejvinder
+#include <cctype>
+#include <limits>
+#include <string>
+#include <thread>
+#include <future>
+#include <vector>
+#include <numeric>
+#include <iostream>
+
+#if defined(MC_BENCH_PARSTL)
+#include <execution>
+#endif
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "cache-utils.hxx"
+#include "executor-utils.hxx"
+#include "telemetry-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+#include "monte-carlo-batch-utils.hxx"
+#include "benchmark-harness-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+// the sample count of the fixed-count case (a compile-time constant)...
+constexpr std::size_t fixed_nsamples = 10'000'000;
+
+//
+// Parses s as a decimal integer in [0, numeric_limits<T>::max()] into n.
+// Unlike stoul() this rejects signs (stoul("-1") wraps), trailing
+// characters and out of range values instead of throwing.
+//
+template <typename T>
+bool parse_count(std::string const& s, T& n) {
+  using namespace std;
+  unsigned long long value = 0;
+  unsigned long long const max = numeric_limits<T>::max();
+  if (s.empty())
+    return false;
+  for (unsigned char const c : s) {
+    if (!isdigit(c) || value > (max - (c - '0')) / 10)
+      return false;
+    value = value * 10 + (c - '0');
+  }
+  n = T(value);
+  return true;
+}
+
+void print_usage(std::ostream& os, char const* name) {
+  os << "Usage: " << name << " [--format=csv|json] [--trials=N]\n"
+        "         [--warmups=N] [--cpu=N] [--samples=N] [--milliseconds=N]\n";
+}
+
+//
+// Usage: monte-carlo-bench.exe [--format=csv|json] [--trials=N]
+//          [--warmups=N] [--cpu=N] [--samples=N] [--milliseconds=N]
+//
+// --samples sets the sample count of the counted mt19937_64 cases (the
+// faster engines run 10 times as many) and --milliseconds sets the length
+// of the timed cases. --cpu pins the single-threaded cases to that CPU
+// (make bench pins them to CPU 0). --trials must be at least 1. N must be
+// a non-negative decimal integer; anything else prints the usage.
+//
+// fixed-count always runs fixed_nsamples samples since its count is a
+// template argument; compare it with serial at the default --samples.
+//
+// The pool-*-block cases run monte_carlo_parallel(), which calls the
+// controller once per block of default_monte_carlo_block_size samples;
+// pool-duration-mutex-per-sample calls it once per sample from every
+// worker.
+//
+int main(int argc, char* argv[]) {
+  using namespace std;
+  using clock_type = chrono::high_resolution_clock;
+
+  benchmark_options options;
+  string format = "csv";
+  size_t nsamples = 10'000'000;
+  chrono::milliseconds run_time(250);
+
+  for (int i = 1; i < argc; ++i) {
+    string const arg = argv[i];
+    auto const eq = arg.find('=');
+    string const key = arg.substr(0, eq);
+    string const value = eq == string::npos ? "" : arg.substr(eq + 1);
+
+    unsigned milliseconds = 0;
+    bool ok = true;
+    if (key == "--format" && (value == "csv" || value == "json"))
+      format = value;
+    else if (key == "--trials")
+      ok = parse_count(value, options.trials);
+    else if (key == "--warmups")
+      ok = parse_count(value, options.warmups);
+    else if (key == "--cpu")
+      ok = parse_count(value, options.cpu);
+    else if (key == "--samples")
+      ok = parse_count(value, nsamples);
+    else if (key == "--milliseconds") {
+      ok = parse_count(value, milliseconds);
+      run_time = chrono::milliseconds(milliseconds);
+    } else
+      ok = false;
+
+    if (!ok) {
+      cerr << "Invalid argument: " << arg << '\n';
+      print_usage(cerr, argv[0]);
+      return 1;
+    }
+  }
+  if (options.trials < 1) {
+    cerr << "--trials must be at least 1\n";
+    print_usage(cerr, argv[0]);
+    return 1;
+  }
+
+  auto mt_op = []()->bool{
+    static thread_local auto xre = make_randomly_seeded_mt19937_64_engine();
+    static thread_local auto yre = make_randomly_seeded_mt19937_64_engine();
+    static thread_local uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
+    return (sqrt(pow(ud(xre), 2) + pow(ud(yre), 2)) <= 1);
+  };
+
+  auto simd_op = [](bool* first, bool* last) {
+    static thread_local auto engine = make_randomly_seeded_simd_xoshiro256plus();
+    in_unit_circle_block_op<simd_xoshiro256plus>{engine}(first, last);
+  };
+
+  auto philox_op = [](philox4x32& e) {
+    return in_unit_circle_block_op<philox4x32>(e);
+  };
+
+  random_stream_factory<> const streams(2019);
+  work_stealing_executor ex;
+  benchmark_harness h(options);
+
+  //
+  // The kernels of the original programs...
+  //
+  h.run("serial", [&]() {
+    return monte_carlo<tally_predicate>(
+      stop_after_count_controller(nsamples), mt_op
+    ).count();
+  });
+
+  h.run("fixed-count", [&]() {
+    return monte_carlo<tally_predicate>(
+      stop_after_fixed_count_controller<fixed_nsamples>{}, mt_op
+    ).count();
+  });
+
+  // like monte-carlo-pi-async.cxx: sample until stopped --milliseconds later...
+  h.run("async", [&]() {
+    stop_when_stopped_controller c;
+    auto result = async(launch::async, [&]() {
+      return monte_carlo_batched<tally_predicate>(c, mt_op);
+    });
+    this_thread::sleep_for(run_time);
+    c.stop();
+    return result.get().count();
+  }, false);
+
+#if defined(MC_BENCH_PARSTL)
+  h.run("parstl-timed", [&]() {
+    stop_at_deadline_controller<clock_type> c(run_time);
+    vector<size_t> indices(8);
+    iota(begin(indices), end(indices), 0);
+    return transform_reduce(
+      execution::par_unseq, begin(indices), end(indices), tally_predicate(),
+      [](tally_predicate const& a, tally_predicate const& b) { return a + b; },
+      [&](size_t const&) { return monte_carlo_batched<tally_predicate>(c, mt_op); }
+    ).count();
+  }, false);
+#endif
+
+  //
+  // Drivers and engines...
+  //
+  h.run("batched", [&]() {
+    return monte_carlo_batched<tally_predicate>(
+      stop_after_count_controller(nsamples), mt_op
+    ).count();
+  });
+
+  h.run("simd-xoshiro256plus", [&]() {
+    return monte_carlo_batched<tally_predicate, bool>(
+      stop_after_count_controller(10 * nsamples), simd_op
+    ).count();
+  });
+
+  h.run("philox4x32", [&]() {
+    philox4x32 e(2019);
+    return monte_carlo_batched<tally_predicate, bool>(
+      stop_after_count_controller(nsamples), philox_op(e)
+    ).count();
+  });
+
+  h.run("pool-n", [&]() {
+    return monte_carlo_parallel_n<tally_predicate, bool>(
+      ex, 10 * nsamples, simd_op
+    ).count();
+  }, false);
+
+  h.run("pool-streams", [&]() {
+    return monte_carlo_parallel_streams<tally_predicate, bool>(
+      ex, streams, nsamples, philox_op
+    ).count();
+  }, false);
+
+  // pool-n with a telemetry_monitor sampling every worker's tally...
+  h.run("pool-n-telemetry", [&]() {
+    auto const pi_estimate = [](tally_predicate const& t) {
+      return 4.0 * t.true_count() / t.count();
+    };
+    using telemetry_type =
+      telemetry_tally<tally_predicate, decltype(pi_estimate)>;
+    telemetry_monitor monitor(ex.size());
+    monitor.start();
+    return monte_carlo_parallel_n<telemetry_type, bool>(
+      ex, 10 * nsamples, simd_op, default_monte_carlo_chunk_size,
+      telemetry_type(monitor, pi_estimate)
+    ).count();
+  }, false);
+
+  // pi as 8 jobs of a monte_carlo_batch sharing one stream of points...
+  h.run("batch", [&]() {
+    monte_carlo_batch batch(2019);
+    vector<monte_carlo_batch_handle<tally_predicate>> handles;
+    for (size_t i = 0; i != 8; ++i)
+      handles.push_back(batch.add<tally_predicate>(
+        "pi-" + to_string(i), 2, stop_after_count_controller(nsamples / 8),
+        [](double const* p) { return p[0] * p[0] + p[1] * p[1] <= 1; }
+      ));
+    batch.run(ex);
+    size_t n = 0;
+    for (auto const& handle : handles)
+      n += batch.tally(handle).count();
+    return n;
+  }, false);
+
+  //
+  // Controllers...
+  //
+  h.run("pool-duration-mutex-block", [&]() {
+    stop_after_duration_controller<clock_type> c(run_time);
+    return monte_carlo_parallel<tally_predicate>(ex, c, mt_op).count();
+  }, false);
+
+  h.run("pool-duration-mutex-per-sample", [&]() {
+    stop_after_duration_controller<clock_type> c(run_time);
+    vector<cache_padded<tally_predicate>> tallies(ex.size());
+    ex.run_indexed(ex.size(), [&](size_t w, size_t) {
+      tallies[w].value = monte_carlo<tally_predicate>(c, mt_op);
+    });
+    size_t n = 0;
+    for (auto const& t : tallies)
+      n += t.value.count();
+    return n;
+  }, false);
+
+  h.run("pool-deadline-block", [&]() {
+    stop_at_deadline_controller<clock_type> c(run_time);
+    return monte_carlo_parallel<tally_predicate>(ex, c, mt_op).count();
+  }, false);
+
+  h.run("precision", [&]() {
+    stop_at_precision_controller c(2e-4, 4);
+    return monte_carlo_batched<tally_predicate, bool>(c, simd_op).count();
+  });
+
+  h.run("pool-precision", [&]() {
+    stop_at_precision_controller c(2e-4, 4);
+    return monte_carlo_parallel_reduced<tally_predicate, bool>(
+      ex, c, simd_op
+    ).count();
+  }, false);
+
+  if (format == "json")
+    h.write_json(cout);
+  else
+    h.write_csv(cout);
+
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Brejvinder
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "executor-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+#include "benchmark-harness-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+//
+// Forwards to Controller but hides its counts_only member, so that the
+// monte_carlo drivers use their general (check every sample or block)
+// loops instead of the specialized counted loops...
+//
+template <typename Controller>
+struct generic_controller {
+  Controller c;
+
+  template <typename Tally>
+  bool operator ()(Tally const& t) const {
+    return c(t);
+  }
+
+  template <typename Tally>
+  std::size_t remaining(Tally const& t) const {
+    return c.remaining(t);
+  }
+};
+
+//
+// Usage: monte-carlo-kernels-bench.exe [--format=csv|json]
+//
+// Runs the same fixed-seed work through the general and the specialized
+// monte_carlo loops, checks that they give identical tallies and writes the
+// timings. Exits with 1 if any pair of results differ.
+//
+// The pool cases run randomly seeded engines on every worker, so their
+// tallies cannot be identical: they must have the same count() and
+// in-circle proportions that agree (|z| < 5).
+//
+int main(int argc, char* argv[]) {
+  using namespace std;
+
+  constexpr size_t N = 50'000'000;
+  uint64_t const seed = 2019;
+
+  auto make_op = []() {
+    return [e = xoshiro256plus(seed)]() mutable -> bool {
+      double const x = uint64_to_unit_double(e());
+      double const y = uint64_to_unit_double(e());
+      return x * x + y * y <= 1;
+    };
+  };
+  auto make_hash_op = []() {
+    return [i = uint64_t(0)]() mutable -> bool {
+      uint64_t s = i++;
+      return splitmix64(s) < (uint64_t(1) << 62) * 3;
+    };
+  };
+
+  auto simd_op = [](bool* first, bool* last) {
+    static thread_local auto engine = make_randomly_seeded_simd_xoshiro256plus();
+    in_unit_circle_block_op<simd_xoshiro256plus>{engine}(first, last);
+  };
+
+  benchmark_harness h;
+  work_stealing_executor ex;
+  bool same = true;
+
+  auto check = [&](char const* what, auto const& a, auto const& b) {
+    if (a != b) {
+      cerr << what << ": " << a << " != " << b << '\n';
+      same = false;
+    }
+  };
+
+  //
+  // Per-sample loops: monte_carlo()...
+  //
+  tally_predicate generic, counted, fixed;
+  h.run("monte_carlo-generic", [&]() {
+    generic = monte_carlo<tally_predicate>(
+      generic_controller<stop_after_count_controller>{N}, make_op()
+    );
+    return generic.count();
+  });
+  h.run("monte_carlo-count", [&]() {
+    counted = monte_carlo<tally_predicate>(
+      stop_after_count_controller(N), make_op()
+    );
+    return counted.count();
+  });
+  h.run("monte_carlo-fixed-count", [&]() {
+    fixed = monte_carlo<tally_predicate>(
+      stop_after_fixed_count_controller<N>{}, make_op()
+    );
+    return fixed.count();
+  });
+  check("count", counted.true_count(), generic.true_count());
+  check("fixed count", fixed.true_count(), generic.true_count());
+
+  // a cheap op (a hash of a counter) where the loop itself matters...
+  tally_predicate generic_hash, counted_hash;
+  h.run("hash-generic", [&]() {
+    generic_hash = monte_carlo<tally_predicate>(
+      generic_controller<stop_after_count_controller>{4 * N}, make_hash_op()
+    );
+    return generic_hash.count();
+  });
+  h.run("hash-count", [&]() {
+    counted_hash = monte_carlo<tally_predicate>(
+      stop_after_count_controller(4 * N), make_hash_op()
+    );
+    return counted_hash.count();
+  });
+  check("hash", counted_hash.true_count(), generic_hash.true_count());
+
+  //
+  // Block loops: monte_carlo_batched() with a per-sample op (so filling a
+  // block is a loop of the block's length) and with a block op...
+  //
+  tally_predicate batched_generic, batched_counted;
+  h.run("batched-hash-generic", [&]() {
+    batched_generic = monte_carlo_batched<tally_predicate, bool>(
+      generic_controller<stop_after_count_controller>{4 * N}, make_hash_op()
+    );
+    return batched_generic.count();
+  });
+  h.run("batched-hash-count", [&]() {
+    batched_counted = monte_carlo_batched<tally_predicate, bool>(
+      stop_after_count_controller(4 * N), make_hash_op()
+    );
+    return batched_counted.count();
+  });
+  check(
+    "batched hash", batched_counted.true_count(), batched_generic.true_count()
+  );
+
+  tally_predicate philox_generic, philox_counted;
+  h.run("batched-philox-generic", [&]() {
+    philox4x32 e(seed);
+    philox_generic = monte_carlo_batched<tally_predicate, bool>(
+      generic_controller<stop_after_count_controller>{N / 10},
+      in_unit_circle_block_op<philox4x32>(e)
+    );
+    return philox_generic.count();
+  });
+  h.run("batched-philox-count", [&]() {
+    philox4x32 e(seed);
+    philox_counted = monte_carlo_batched<tally_predicate, bool>(
+      stop_after_count_controller(N / 10), in_unit_circle_block_op<philox4x32>(e)
+    );
+    return philox_counted.count();
+  });
+  check(
+    "batched philox", philox_counted.true_count(), philox_generic.true_count()
+  );
+
+  //
+  // Parallel: chunks handed out from a shared counter vs an even split...
+  //
+  tally_predicate chunked, split;
+  h.run("pool-chunks", [&]() {
+    chunked = monte_carlo_parallel_n<tally_predicate, bool>(
+      ex, 10 * N, simd_op
+    );
+    return chunked.count();
+  }, false);
+  h.run("pool-split", [&]() {
+    split = monte_carlo_parallel_split<tally_predicate, bool>(
+      ex, stop_after_count_controller(10 * N), simd_op
+    );
+    return split.count();
+  }, false);
+  check("pool count", split.count(), chunked.count());
+  {
+    double const pa = double(split.true_count()) / split.count();
+    double const pb = double(chunked.true_count()) / chunked.count();
+    double const p = (pa + pb) / 2;
+    double const z = (pa - pb) / std::sqrt(p * (1 - p) * 2 / split.count());
+    check("pool |z| < 5", std::abs(z) < 5, true);
+  }
+
+  if (argc > 1 && string(argv[1]) == "--format=json")
+    h.write_json(cout);
+  else
+    h.write_csv(cout);
+
+  cerr << "Results are " << (same ? "" : "NOT ") << "identical\n";
+  return same ? 0 : 1;
+}
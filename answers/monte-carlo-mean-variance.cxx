@@ -0,0 +1,102 @@
+// Brejvinder
+#include <cmath>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+//
+// Returns |a - b| relative to |b| (or the absolute difference if b is 0).
+//
+double relative_error(double const a, double const b) {
+  return b == 0 ? std::abs(a - b) : std::abs((a - b) / b);
+}
+
+template <typename Tally>
+bool check(char const* what, Tally const& t, long double mean, long double var) {
+  using namespace std;
+
+  double const tolerance = 1e-9;
+  double const mean_err = relative_error(t.mean(), mean);
+  double const var_err = relative_error(t.variance(), var);
+  bool const ok = mean_err < tolerance && var_err < tolerance;
+
+  cout
+      << setw(16) << left << what << right
+      << " mean rel. error = " << setw(10) << setprecision(3) << mean_err
+      << "  variance rel. error = " << setw(10) << var_err
+      << "  " << (ok ? "PASS" : "FAIL") << '\n';
+  return ok;
+}
+
+int main() {
+  using namespace std;
+
+  //
+  // The same sequence of values is tallied serially, in chunks that are
+  // merged, in bulk blocks and in parallel. All must agree with a long
+  // double two-pass computation within tolerance.
+  //
+  size_t const n = 10'000'000;
+  vector<double> values(n);
+  xoshiro256plus re(2019);
+  for (auto& v : values)
+    v = 1e6 + uint64_to_unit_double(re());   // a large offset is the hard case
+
+  tally_mean_variance<double> serial;
+  for (auto const& v : values)
+    serial(v);
+
+  // merge chunks of (pseudo-)random sizes...
+  tally_mean_variance<double> merged;
+  for (size_t i = 0; i != n;) {
+    size_t const len = min<size_t>(n - i, 1 + re() % 100'000);
+    tally_mean_variance<double> chunk;
+    for (size_t j = i; j != i + len; ++j)
+      chunk(values[j]);
+    merged += chunk;
+    i += len;
+  }
+
+  // tally blocks using the bulk operator...
+  tally_mean_variance<double> bulk;
+  for (size_t i = 0; i < n; i += 1000)
+    bulk(values.data() + i, values.data() + min(n, i + 1000));
+
+  // tally in parallel with a thread per core...
+  work_stealing_executor ex;
+  atomic<size_t> next{0};
+  auto const parallel = monte_carlo_parallel_n<tally_mean_variance<double>>(
+    ex, n, [&values, &next]() { return values[next.fetch_add(1)]; }
+  );
+
+  tally_mean_variance<double, true> compensated;
+  for (auto const& v : values)
+    compensated(v);
+
+  // reference values using a two-pass long double computation...
+  long double sum = 0;
+  for (auto const& v : values)
+    sum += v;
+  long double const mean = sum / n;
+  long double m2 = 0;
+  for (auto const& v : values)
+    m2 += (v - mean) * (v - mean);
+  long double const var = m2 / (n - 1);
+
+  bool ok = serial.count() == n && merged.count() == n &&
+            bulk.count() == n && parallel.count() == n;
+  ok &= check("serial", serial, mean, var);
+  ok &= check("merged chunks", merged, mean, var);
+  ok &= check("bulk blocks", bulk, mean, var);
+  ok &= check("parallel", parallel, mean, var);
+  ok &= check("compensated", compensated, mean, var);
+  cout << (ok ? "PASS" : "FAIL") << endl;
+
+  return ok ? 0 : 1;
+}
@@ -22,7 +22,7 @@ int main() {
 
   auto future_result = async(launch::async, [&swsc, &bm]() {
     bm.start();
-    auto result = monte_carlo<tally_predicate>(swsc, []()->bool{
+    auto result = monte_carlo_batched<tally_predicate>(swsc, []()->bool{
       static thread_local auto xre = make_randomly_seeded_mt19937_64_engine();
       static thread_local auto yre = make_randomly_seeded_mt19937_64_engine();
       static thread_local uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
@@ -0,0 +1,143 @@
+// Brejvinder
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "checkpoint-utils.hxx"
+#include "controller-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+//
+// Usage: monte-carlo-pi-checkpoint.exe [file]
+//
+// Without arguments: runs the pi estimator on philox4x32 streams once
+// uninterrupted and once preempted after a short deadline and then resumed
+// from its checkpoint, and checks that both give bit-identical results.
+//
+// With a file: runs (or resumes) a long run checkpointed to that file. Kill
+// it at any time and run it again to continue where it left off.
+//
+int main(int argc, char* argv[]) {
+  using namespace std;
+  using clock_type = chrono::steady_clock;
+
+  uint64_t const run_id = 2019;
+  size_t const nstreams = 16;
+  random_stream_factory<> const streams(run_id);
+
+  auto make_op = [](philox4x32& e) {
+    return in_unit_circle_block_op<philox4x32>(e);
+  };
+
+  auto print = [](string const& name, tally_predicate const& t, double s) {
+    cout
+        << setw(14) << name
+        << setw(14) << t.count()
+        << setw(14) << t.true_count()
+        << setw(24) << setprecision(18) << 4.0L * t.true_count() / t.count()
+        << setw(10) << setprecision(3) << s << "s\n";
+  };
+
+  work_stealing_executor ex;
+
+  if (argc > 1) {
+    size_t const n = 50'000'000;   // per stream
+    never_stop_controller never;
+    benchmark<clock_type> bm;
+    bm.start();
+    auto const t = monte_carlo_checkpointed<tally_predicate, bool>(
+      ex, streams, nstreams, n, make_op, argv[1], run_id, never,
+      chrono::seconds(1)
+    );
+    bm.stop();
+    print("result", t, duration_convert<double>(bm.duration()).count());
+    return 0;
+  }
+
+  size_t const n = 4'000'000;   // per stream
+  string const path = "monte-carlo-pi-checkpoint.ckpt";
+  remove(path.c_str());
+
+  cout
+      << setw(14) << "run"
+      << setw(14) << "samples"
+      << setw(14) << "in circle"
+      << setw(24) << "estimate of pi"
+      << setw(11) << "time" << '\n';
+
+  benchmark<clock_type> bm;
+
+  // the reference: no checkpoint file, so this starts a new run...
+  bm.start();
+  auto const reference = monte_carlo_checkpointed<tally_predicate, bool>(
+    ex, streams, nstreams, n, make_op, path, run_id,
+    never_stop_controller(), chrono::milliseconds(20)
+  );
+  bm.stop();
+  print("uninterrupted", reference, duration_convert<double>(bm.duration()).count());
+  remove(path.c_str());
+
+  // preempt the run at a deadline (it writes a final checkpoint)...
+  stop_at_deadline_controller<clock_type> deadline(
+    chrono::duration_cast<clock_type::duration>(bm.duration()) / 3
+  );
+  bm.start();
+  auto const partial = monte_carlo_checkpointed<tally_predicate, bool>(
+    ex, streams, nstreams, n, make_op, path, run_id, deadline,
+    chrono::milliseconds(20)
+  );
+  bm.stop();
+  print("preempted", partial, duration_convert<double>(bm.duration()).count());
+
+  auto const cp = load_checkpoint<tally_predicate>(path);
+  cout << "Checkpoint holds " << cp->merged.count() << " samples\n";
+
+  // ...and resume it from the checkpoint...
+  bm.start();
+  auto const resumed = monte_carlo_checkpointed<tally_predicate, bool>(
+    ex, streams, nstreams, n, make_op, path, run_id,
+    never_stop_controller(), chrono::milliseconds(20)
+  );
+  bm.stop();
+  print("resumed", resumed, duration_convert<double>(bm.duration()).count());
+  remove(path.c_str());
+
+  // preempt it with a controller that would stop mid-block (its remaining()
+  // is not used, so it stops at the next block boundary) and resume it...
+  bm.start();
+  auto const counted = monte_carlo_checkpointed<tally_predicate, bool>(
+    ex, streams, nstreams, n, make_op, path, run_id,
+    stop_after_count_or_when_stopped_controller(n / 3 + 123),
+    chrono::milliseconds(20)
+  );
+  bm.stop();
+  print("preempted", counted, duration_convert<double>(bm.duration()).count());
+
+  bm.start();
+  auto const resumed_counted = monte_carlo_checkpointed<tally_predicate, bool>(
+    ex, streams, nstreams, n, make_op, path, run_id,
+    never_stop_controller(), chrono::milliseconds(20)
+  );
+  bm.stop();
+  print(
+    "resumed", resumed_counted, duration_convert<double>(bm.duration()).count()
+  );
+  remove(path.c_str());
+
+  bool const same =
+    resumed.count() == reference.count() &&
+    resumed.true_count() == reference.true_count() &&
+    resumed_counted.count() == reference.count() &&
+    resumed_counted.true_count() == reference.true_count();
+  cout << "Resumed runs are " << (same ? "" : "NOT ") << "bit-identical\n";
+
+  return same ? 0 : 1;
+}
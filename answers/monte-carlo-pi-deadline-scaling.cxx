@@ -0,0 +1,154 @@
+// Brejvinder
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <algorithm>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+//
+// Runs the pi estimator on nthreads threads that all share controller c and
+// returns the total number of samples per second.
+//
+template <typename Controller>
+double samples_per_second(std::size_t const nthreads, Controller& c) {
+  using namespace std;
+
+  benchmark<chrono::high_resolution_clock> bm;
+  vector<tally_predicate> tallies(nthreads);
+  vector<thread> threads;
+  threads.reserve(nthreads);
+
+  bm.start();
+  for (size_t i = 0; i != nthreads; ++i)
+    threads.emplace_back([&c, &tally = tallies[i]]() {
+      tally = monte_carlo<tally_predicate>(c, []()->bool{
+        static thread_local auto xre = make_randomly_seeded_mt19937_64_engine();
+        static thread_local auto yre = make_randomly_seeded_mt19937_64_engine();
+        static thread_local uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
+        return (sqrt(pow(ud(xre), 2) + pow(ud(yre), 2)) <= 1);
+      });
+    });
+  for (auto& t : threads)
+    t.join();
+  bm.stop();
+
+  tally_predicate total;
+  for (auto const& t : tallies)
+    total += t;
+
+  return total.count() / duration_convert<double>(bm.duration()).count();
+}
+
+//
+// Runs the pi estimator on one thread, continuing tally (which may already
+// hold samples, e.g., from a checkpoint), until controller c's deadline and
+// returns by how much the run overshot that deadline.
+//
+template <typename Controller>
+typename Controller::duration_type deadline_overshoot(
+  Controller& c, tally_predicate tally
+) {
+  using namespace std;
+
+  xoshiro256plus re(tally.count());
+  uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
+  monte_carlo_tally(c, tally, [&]()->bool{
+    return (sqrt(pow(ud(re), 2) + pow(ud(re), 2)) <= 1);
+  });
+  return Controller::clock_type::now() - c.deadline();
+}
+
+int main() {
+  using namespace std;
+  using clock_type = chrono::high_resolution_clock;
+
+  auto const run_time = 500ms;
+  size_t const ncores = max(1U, thread::hardware_concurrency());
+
+  vector<size_t> nthreads;
+  for (size_t n = 1; n < ncores; n *= 2)
+    nthreads.push_back(n);
+  nthreads.push_back(ncores);
+
+  cout
+      << "Samples/sec with all threads sharing one controller ("
+      << duration_convert(run_time).count() << " seconds per run).\n"
+      << setw(8) << "threads"
+      << setw(16) << "mutex"
+      << setw(16) << "lock-free"
+      << setw(10) << "speedup"
+      << '\n';
+
+  for (auto const& n : nthreads) {
+    stop_after_duration_controller<clock_type> mutex_c(run_time);
+    auto const mutex_rate = samples_per_second(n, mutex_c);
+
+    stop_at_deadline_controller<clock_type> lock_free_c(run_time);
+    auto const lock_free_rate = samples_per_second(n, lock_free_c);
+
+    cout
+        << setw(8) << n
+        << setw(16) << setprecision(4) << mutex_rate
+        << setw(16) << setprecision(4) << lock_free_rate
+        << setw(10) << setprecision(3) << lock_free_rate / mutex_rate
+        << endl;
+  }
+
+  //
+  // The controller should stop within about latency() of its deadline,
+  // including when the tally already holds many samples (the stride must
+  // follow the samples done since the deadline was set, not count()). The
+  // median of several runs is checked so one preempted run does not fail.
+  //
+  auto const check_time = 200ms;
+  size_t const check_runs = 5;
+  auto const ms = [](auto const& d) {
+    return chrono::duration<double, milli>(d).count();
+  };
+  bool overshot = false;
+  cout << "\nOvershoot of a " << duration_convert(check_time).count()
+       << " second deadline (one thread, " << check_runs << " runs).\n"
+       << setw(16) << "tally samples"
+       << setw(12) << "min (ms)"
+       << setw(12) << "median (ms)"
+       << setw(12) << "max (ms)"
+       << setw(14) << "latency (ms)"
+       << setw(10) << "stride"
+       << '\n';
+  for (size_t const prefill : { size_t(0), size_t(3'000'000'000) }) {
+    vector<clock_type::duration> overshoots;
+    clock_type::duration latency{};
+    size_t stride = 0;
+    for (size_t i = 0; i != check_runs; ++i) {
+      stop_at_deadline_controller<clock_type> c(check_time);
+      overshoots.push_back(deadline_overshoot(c, tally_predicate(prefill, 0)));
+      latency = c.latency();
+      stride = max(stride, c.stride());
+    }
+    sort(overshoots.begin(), overshoots.end());
+    auto const median = overshoots[check_runs / 2];
+    overshot = overshot || median > latency;
+    cout
+        << setw(16) << prefill
+        << setw(12) << setprecision(3) << ms(overshoots.front())
+        << setw(12) << setprecision(3) << ms(median)
+        << setw(12) << setprecision(3) << ms(overshoots.back())
+        << setw(14) << setprecision(3) << ms(latency)
+        << setw(10) << stride
+        << endl;
+  }
+  if (overshot)
+    cout << "FAILED: runs overshot the deadline by more than latency().\n";
+
+  return overshot ? 1 : 0;
+}
@@ -29,7 +29,7 @@ int main() {
   benchmark<chrono::high_resolution_clock> bm;
   bm.start();
 
-  stop_after_duration_controller<chrono::high_resolution_clock> swsc(2s);
+  stop_at_deadline_controller<chrono::high_resolution_clock> swsc(2s);
 
   vector<size_t> indices(ninvocations);
   iota(begin(indices), end(indices), 0);
@@ -40,7 +40,7 @@ int main() {
                                 tally_predicate(),
   [](tally_predicate const & tally1, tally_predicate const & tally2) {return (tally1 + tally2);},
   [&swsc](size_t const&) {
-    return monte_carlo<tally_predicate>(swsc, []()->bool{
+    return monte_carlo_batched<tally_predicate>(swsc, []()->bool{
       static thread_local auto xre = make_randomly_seeded_mt19937_64_engine();
       static thread_local auto yre = make_randomly_seeded_mt19937_64_engine();
       static thread_local uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
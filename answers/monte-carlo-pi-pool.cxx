@@ -0,0 +1,73 @@
+// Brejvinder
+#include <thread>
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+template <typename Tally, typename Benchmark>
+void print_result(char const* what, Tally const& total, Benchmark& bm) {
+  using namespace std;
+
+  auto const default_cout_width = cout.width();
+  auto const default_cout_precision = cout.precision();
+
+  cout
+      << what << ": " << total.count() << " samples.\n"
+      << "  Estimate of pi = "
+      << setw(numeric_limits<REAL>::max_digits10)
+      << setprecision(numeric_limits<REAL>::max_digits10)
+      << REAL(total.true_count()) / REAL(total.count()) * REAL(4)
+      << "\n  Total elapsed time = "
+      << setw(default_cout_width)
+      << setprecision(default_cout_precision)
+      << duration_convert(bm.duration()).count()
+      << " seconds."
+      << endl;
+}
+
+int main() {
+  using namespace std;
+
+  auto op = []()->bool{
+    static thread_local auto xre = make_randomly_seeded_mt19937_64_engine();
+    static thread_local auto yre = make_randomly_seeded_mt19937_64_engine();
+    static thread_local uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
+    return (sqrt(pow(ud(xre), 2) + pow(ud(yre), 2)) <= 1);
+  };
+
+  // the same executor (and its threads) is used for every run below...
+  work_stealing_executor ex;
+  cout << "Using " << ex.size() << " worker threads.\n";
+
+  benchmark<chrono::high_resolution_clock> bm;
+  for (int run = 1; run <= 2; ++run) {
+    cout << "Running for 1 second... "; cout.flush();
+    stop_at_deadline_controller<chrono::high_resolution_clock> c(1s);
+    bm.start();
+    auto const total = monte_carlo_parallel<tally_predicate>(ex, c, op);
+    bm.stop();
+    cout << "Done.\n";
+    print_result("Timed run", total, bm);
+  }
+
+  cout << "Running 50 million samples... "; cout.flush();
+  bm.start();
+  auto const total = monte_carlo_parallel_n<tally_predicate>(
+    ex, 50'000'000, op
+  );
+  bm.stop();
+  cout << "Done.\n";
+  print_result("Counted run", total, bm);
+
+  return 0;
+}
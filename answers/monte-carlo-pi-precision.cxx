@@ -0,0 +1,85 @@
+// Brejvinder
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+template <typename Benchmark>
+void print_result(
+  char const* what,
+  tally_predicate const& result,
+  stop_at_precision_controller const& c,
+  std::size_t const fixed_count,
+  Benchmark& bm
+) {
+  using namespace std;
+
+  auto const default_cout_width = cout.width();
+  auto const default_cout_precision = cout.precision();
+
+  cout
+      << what << ": " << result.count() << " samples.\n"
+      << "  Estimate of pi = "
+      << setw(numeric_limits<REAL>::max_digits10)
+      << setprecision(numeric_limits<REAL>::max_digits10)
+      << REAL(result.true_count()) / REAL(result.count()) * REAL(4)
+      << setw(default_cout_width)
+      << setprecision(default_cout_precision)
+      << " +/- " << c.half_width(result) << " (95% CI)\n"
+      << "  Precision checks = " << c.checks()
+      << "\n  Samples saved vs. a fixed " << fixed_count << " sample run = "
+      << c.samples_saved(fixed_count, result)
+      << "\n  Total elapsed time = "
+      << duration_convert(bm.duration()).count()
+      << " seconds."
+      << endl;
+}
+
+int main() {
+  using namespace std;
+
+  // the sample count used by monte-carlo-pi-serial.cxx...
+  size_t const fixed_count = 50'000'0000;
+  double const epsilon = 2e-4;
+
+  cout << "Estimating pi to +/- " << epsilon << " (95% CI)...\n";
+
+  benchmark<chrono::high_resolution_clock> bm;
+  {
+    stop_at_precision_controller c(epsilon, 4);
+    auto engine = make_randomly_seeded_simd_xoshiro256plus();
+    bm.start();
+    auto const result = monte_carlo_batched<tally_predicate, bool>(
+      c, in_unit_circle_block_op<simd_xoshiro256plus>(engine)
+    );
+    bm.stop();
+    print_result("Serial", result, c, fixed_count, bm);
+  }
+
+  {
+    work_stealing_executor ex;
+    stop_at_precision_controller c(epsilon, 4);
+    bm.start();
+    auto const result = monte_carlo_parallel_reduced<tally_predicate, bool>(
+      ex, c, [](bool* first, bool* last) {
+        static thread_local auto engine =
+          make_randomly_seeded_simd_xoshiro256plus();
+        in_unit_circle_block_op<simd_xoshiro256plus>{engine}(first, last);
+      }
+    );
+    bm.stop();
+    print_result("Parallel (reduced)", result, c, fixed_count, bm);
+  }
+
+  return 0;
+}
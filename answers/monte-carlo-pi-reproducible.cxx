@@ -0,0 +1,88 @@
+// Brejvinder
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "executor-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+int main() {
+  using namespace std;
+
+  size_t const nsamples = 100'000'000;
+  random_stream_factory<> const streams(2019);
+
+  size_t const ncores = max(1U, thread::hardware_concurrency());
+  vector<size_t> nworkers{1, 2, ncores, 2 * ncores + 1};
+
+  cout
+      << "Estimating pi with " << nsamples << " samples (master seed "
+      << streams.seed() << ").\n"
+      << setw(8) << "workers"
+      << setw(14) << "in circle"
+      << setw(26) << "estimate of pi"
+      << setw(26) << "mean of x*x+y*y"
+      << setw(12) << "seconds"
+      << '\n';
+
+  benchmark<chrono::high_resolution_clock> bm;
+  tally_predicate first_pi;
+  tally_mean_variance<double> first_r2;
+  bool identical = true;
+
+  for (auto const& n : nworkers) {
+    work_stealing_executor ex(n);
+
+    bm.start();
+    auto const pi = monte_carlo_parallel_streams<tally_predicate, bool>(
+      ex, streams, nsamples, [](philox4x32& e) {
+        return in_unit_circle_block_op<philox4x32>(e);
+      }
+    );
+    auto const r2 = monte_carlo_parallel_streams<tally_mean_variance<double>>(
+      ex, streams, nsamples / 10, [](philox4x32& e) {
+        return [&e]() {
+          double const x = uint64_to_unit_double(e());
+          double const y = uint64_to_unit_double(e());
+          return x * x + y * y;
+        };
+      }
+    );
+    bm.stop();
+
+    if (n == nworkers.front()) {
+      first_pi = pi;
+      first_r2 = r2;
+    }
+    identical = identical &&
+      pi.true_count() == first_pi.true_count() &&
+      r2.mean() == first_r2.mean() &&
+      r2.variance() == first_r2.variance();
+
+    cout
+        << setw(8) << n
+        << setw(14) << pi.true_count()
+        << setw(26) << setprecision(numeric_limits<REAL>::max_digits10)
+        << REAL(pi.true_count()) / REAL(pi.count()) * REAL(4)
+        << setw(26) << setprecision(numeric_limits<double>::max_digits10)
+        << r2.mean()
+        << setw(12) << setprecision(4)
+        << duration_convert(bm.duration()).count()
+        << endl;
+  }
+
+  cout
+      << "Results are " << (identical ? "" : "NOT ")
+      << "bit-identical for all worker counts." << endl;
+
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,199 @@
+// Brejvinder
+#include <cmath>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+using REAL = long double;
+
+//
+// Returns the z statistic for the difference of the in-circle proportions
+// of two independent tallies. If both come from a uniform generator then
+// |z| should rarely exceed 4.
+//
+double two_proportion_z(tally_predicate const& a, tally_predicate const& b) {
+  double const pa = double(a.true_count()) / a.count();
+  double const pb = double(b.true_count()) / b.count();
+  double const p = double(a.true_count() + b.true_count()) /
+                   (a.count() + b.count());
+  double const se = std::sqrt(p * (1 - p) * (1.0 / a.count() + 1.0 / b.count()));
+  return (pa - pb) / se;
+}
+
+// Returns the z statistic of the tally's proportion against pi/4.
+double pi_z(tally_predicate const& t) {
+  double const p = std::acos(-1.0) / 4;
+  double const pt = double(t.true_count()) / t.count();
+  return (pt - p) / std::sqrt(p * (1 - p) / t.count());
+}
+
+//
+// Returns the (Wilson-Hilferty) z statistic of a chi-square value with df
+// degrees of freedom.
+//
+double chi_square_z(double chi2, double df) {
+  double const v = 2 / (9 * df);
+  return (std::cbrt(chi2 / df) - (1 - v)) / std::sqrt(v);
+}
+
+//
+// Value k * lanes + i of v is lane i's k-th value. Returns the largest |z|
+// of a chi-square test of each lane's values for uniformity over nbins
+// equal bins of [0,1).
+//
+template <typename T>
+double max_lane_uniformity_z(std::vector<T> const& v, std::size_t lanes,
+                             std::size_t nbins = 64) {
+  double worst = 0;
+  std::size_t const n = v.size() / lanes;
+  for (std::size_t i = 0; i != lanes; ++i) {
+    std::vector<std::size_t> bins(nbins);
+    for (std::size_t k = 0; k != n; ++k)
+      ++bins[std::min(nbins - 1, std::size_t(v[k * lanes + i] * nbins))];
+    double const expected = double(n) / nbins;
+    double chi2 = 0;
+    for (auto const& b : bins)
+      chi2 += (b - expected) * (b - expected) / expected;
+    worst = std::max(worst, std::abs(chi_square_z(chi2, nbins - 1)));
+  }
+  return worst;
+}
+
+//
+// Returns the largest |r| * sqrt(n) (which is approximately standard
+// normal for independent lanes) of the correlations r between the values
+// of each pair of lanes at the same step.
+//
+template <typename T>
+double max_lane_correlation_z(std::vector<T> const& v, std::size_t lanes) {
+  std::size_t const n = v.size() / lanes;
+  std::vector<double> mean(lanes), sd(lanes);
+  for (std::size_t i = 0; i != lanes; ++i) {
+    for (std::size_t k = 0; k != n; ++k)
+      mean[i] += v[k * lanes + i];
+    mean[i] /= n;
+    for (std::size_t k = 0; k != n; ++k)
+      sd[i] += (v[k * lanes + i] - mean[i]) * (v[k * lanes + i] - mean[i]);
+    sd[i] = std::sqrt(sd[i]);
+  }
+
+  double worst = 0;
+  for (std::size_t i = 0; i != lanes; ++i)
+    for (std::size_t j = i + 1; j != lanes; ++j) {
+      double c = 0;
+      for (std::size_t k = 0; k != n; ++k)
+        c += (v[k * lanes + i] - mean[i]) * (v[k * lanes + j] - mean[j]);
+      worst = std::max(worst, std::abs(c / (sd[i] * sd[j])) * std::sqrt(n));
+    }
+  return worst;
+}
+
+int main() {
+  using namespace std;
+
+  size_t const nbaseline = 20'000'000;
+  size_t const nsimd = 500'000'000;
+
+  //
+  // Baseline: the monte-carlo-pi-serial.cxx kernel...
+  //
+  cout << "Running mt19937_64 baseline... "; cout.flush();
+  benchmark<chrono::high_resolution_clock> bm;
+  bm.start();
+  auto const baseline = monte_carlo<tally_predicate>(
+    stop_after_count_controller(nbaseline),
+    []()->bool{
+      static auto xre = make_randomly_seeded_mt19937_64_engine();
+      static auto yre = make_randomly_seeded_mt19937_64_engine();
+      static uniform_real_distribution<REAL> ud(REAL(0), REAL(1));
+      return (sqrt(pow(ud(xre), 2) + pow(ud(yre), 2)) <= 1);
+    }
+  );
+  bm.stop();
+  auto const baseline_seconds = duration_convert<double>(bm.duration()).count();
+  cout << "Done.\n";
+
+  //
+  // SIMD: simd_xoshiro256plus with the in-circle block op...
+  //
+  cout << "Running simd_xoshiro256plus... "; cout.flush();
+  auto engine = make_randomly_seeded_simd_xoshiro256plus();
+  bm.start();
+  auto const simd = monte_carlo_batched<tally_predicate, bool>(
+    stop_after_count_controller(nsimd),
+    in_unit_circle_block_op<simd_xoshiro256plus>(engine)
+  );
+  bm.stop();
+  auto const simd_seconds = duration_convert<double>(bm.duration()).count();
+  cout << "Done.\n";
+
+  //
+  // Per-lane uniformity and inter-lane correlation of the raw values, with
+  // mt19937_64 values split into the same number of "lanes" as a control.
+  // doubles have simd_xoshiro256plus::lanes lanes and floats twice as many
+  // (the two halves of each output)...
+  //
+  size_t const nper_lane = 1 << 20;
+  size_t const lanes = simd_xoshiro256plus::lanes;
+
+  vector<double> mt_values(lanes * nper_lane);
+  {
+    auto mt = make_randomly_seeded_mt19937_64_engine();
+    uniform_real_distribution<double> ud(0, 1);
+    for (auto& x : mt_values)
+      x = ud(mt);
+  }
+  vector<double> simd_doubles(lanes * nper_lane);
+  engine.generate(simd_doubles.data(), simd_doubles.data() + simd_doubles.size());
+  vector<float> simd_floats(2 * lanes * nper_lane);
+  engine.generate(simd_floats.data(), simd_floats.data() + simd_floats.size());
+
+  double const uniform_mt = max_lane_uniformity_z(mt_values, lanes);
+  double const uniform_d = max_lane_uniformity_z(simd_doubles, lanes);
+  double const uniform_f = max_lane_uniformity_z(simd_floats, 2 * lanes);
+  double const corr_mt = max_lane_correlation_z(mt_values, lanes);
+  double const corr_d = max_lane_correlation_z(simd_doubles, lanes);
+  double const corr_f = max_lane_correlation_z(simd_floats, 2 * lanes);
+
+  auto const baseline_rate = baseline.count() / baseline_seconds;
+  auto const simd_rate = simd.count() / simd_seconds;
+  auto const z_pi = pi_z(simd);
+  auto const z_both = two_proportion_z(simd, baseline);
+  // (the max over many lanes or pairs of lanes, so a looser bound)...
+  bool const pass =
+    abs(z_pi) < 4 && abs(z_both) < 4 &&
+    max({ uniform_d, uniform_f, corr_d, corr_f }) < 5;
+
+  cout
+      << setprecision(numeric_limits<REAL>::max_digits10)
+      << "mt19937_64 estimate of pi = "
+      << REAL(baseline.true_count()) / REAL(baseline.count()) * REAL(4)
+      << " (" << baseline.count() << " samples)\n"
+      << "SIMD estimate of pi       = "
+      << REAL(simd.true_count()) / REAL(simd.count()) * REAL(4)
+      << " (" << simd.count() << " samples)\n"
+      << setprecision(4)
+      << "mt19937_64 samples/sec = " << baseline_rate << '\n'
+      << "SIMD samples/sec       = " << simd_rate << '\n'
+      << "Speedup = " << simd_rate / baseline_rate << "x\n"
+      << "z (SIMD vs pi/4) = " << z_pi << '\n'
+      << "z (SIMD vs mt19937_64) = " << z_both << '\n'
+      << "max lane uniformity |z|: mt19937_64 " << uniform_mt
+      << ", SIMD doubles " << uniform_d << ", SIMD floats " << uniform_f << '\n'
+      << "max lane correlation |z|: mt19937_64 " << corr_mt
+      << ", SIMD doubles " << corr_d << ", SIMD floats " << corr_f << '\n'
+      << "Statistical check: " << (pass ? "PASS" : "FAIL")
+      << endl;
+
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// Brejvinder
+#include <array>
+#include <future>
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+#include "tally-utils.hxx"
+#include "random-utils.hxx"
+#include "pi-kernel-utils.hxx"
+#include "executor-utils.hxx"
+#include "telemetry-utils.hxx"
+#include "benchmark-utils.hxx"
+#include "controller-utils.hxx"
+#include "monte-carlo-utils.hxx"
+#include "benchmark-harness-utils.hxx"
+
+#include "project-tally-task.hxx"
+
+//
+// Usage: monte-carlo-pi-telemetry.exe [file [json|prometheus]]
+//
+// Runs the pi estimator with monte_carlo_parallel() on every worker of a
+// work_stealing_executor until stopped while printing live telemetry. If a
+// file is given the telemetry is also written to it. Beforehand the
+// overhead of the telemetry is measured (see below) and the program exits
+// with 1 (after the live run) if it exceeds 1% of the time per sample.
+//
+int main(int argc, char* argv[]) {
+  using namespace std;
+
+  auto const pi_estimate = [](tally_predicate const& t) {
+    return 4.0 * t.true_count() / t.count();
+  };
+
+  auto op = [](bool* first, bool* last) {
+    static thread_local auto engine = make_randomly_seeded_simd_xoshiro256plus();
+    in_unit_circle_block_op<simd_xoshiro256plus>{engine}(first, last);
+  };
+
+  work_stealing_executor ex;
+  size_t const nworkers = ex.size();
+  using telemetry_type = telemetry_tally<tally_predicate, decltype(pi_estimate)>;
+  using bool_block = array<bool, default_monte_carlo_block_size>;
+
+  //
+  // Measure the overhead of the telemetry's hot path, i.e., the cost of
+  // telemetry_tally::operator ()(first, last) over that of the plain
+  // tally, on blocks of samples made beforehand. (Timing whole runs with
+  // and without telemetry mostly measures how the stack frames of the two
+  // instantiations happen to line up, which moves either one by far more
+  // than 1%.) The two tallies alternate over nrounds rounds on the main
+  // thread pinned to CPU 0 and each round's extra time per sample is taken
+  // relative to the time per sample of monte_carlo_parallel_n() on one
+  // worker pinned to the same CPU. The median and interquartile range over
+  // the rounds are reported...
+  //
+  size_t const block_size = default_monte_carlo_block_size;
+  size_t const nblocks = 256;
+  size_t const npasses = 16;
+  size_t const nrounds = 401;
+  size_t const nsamples = 20'000'000;
+  double const max_overhead = 0.01;
+
+  vector<double> overheads;
+  double sample_ns = 0;
+  {
+    cpu_affinity_guard const pin(0);
+    benchmark<chrono::steady_clock> bm;
+    auto seconds = [&](auto&& run) {
+      bm.start();
+      run();
+      bm.stop();
+      return duration_convert<double>(bm.duration()).count();
+    };
+
+    // the time per sample of the whole pipeline...
+    work_stealing_executor ex1(1);
+    vector<double> pipeline;
+    for (size_t r = 0; r != 10; ++r)
+      pipeline.push_back(seconds([&]() {
+        monte_carlo_parallel_n<tally_predicate, bool>(ex1, nsamples, op);
+      }) / nsamples);
+    pipeline.erase(pipeline.begin());     // the first run is a warm-up
+    double const sample_s = benchmark_detail::median(pipeline);
+    sample_ns = sample_s * 1e9;
+
+    // ...and the tallies alone...
+    vector<bool_block> blocks(nblocks);
+    for (auto& b : blocks)
+      op(b.data(), b.data() + block_size);
+
+    telemetry_monitor monitor(1);
+    monitor.start();
+    tally_predicate plain;
+    telemetry_type telemetry(monitor.slot(0), pi_estimate);
+    auto tally_s = [&](auto& tally) {
+      return seconds([&]() {
+        for (size_t p = 0; p != npasses; ++p)
+          for (auto const& b : blocks)
+            tally(b.data(), b.data() + block_size);
+      }) / (npasses * nblocks * block_size);
+    };
+
+    for (size_t r = 0; r != nrounds + 1; ++r) {
+      double const plain_s = tally_s(plain);
+      double const telemetry_s = tally_s(telemetry);
+      if (r != 0)                         // the first round is a warm-up
+        overheads.push_back((telemetry_s - plain_s) / sample_s);
+    }
+
+    // (this also keeps the compiler from dropping the plain tally)...
+    if (plain.true_count() != telemetry.true_count())
+      throw logic_error("the plain and telemetry tallies differ");
+  }
+  double const overhead = benchmark_detail::median(overheads);
+  bool const too_slow = overhead > max_overhead;
+
+  cout
+      << setprecision(3)
+      << "Telemetry overhead: median " << overhead * 100
+      << "% (interquartile range "
+      << benchmark_detail::quantile(overheads, 0.25) * 100 << "% to "
+      << benchmark_detail::quantile(overheads, 0.75) * 100 << "%) of "
+      << sample_ns << " ns per sample on 1 pinned worker, "
+      << nrounds << " rounds\n";
+  if (too_slow)
+    cout << "FAILED: the telemetry overhead exceeds "
+         << max_overhead * 100 << "%.\n";
+
+  //
+  // Live telemetry of an open-ended run...
+  //
+  telemetry_monitor monitor(nworkers, 250ms);
+  if (argc > 1)
+    monitor.write_to(
+      argv[1],
+      argc > 2 && string(argv[2]) == "prometheus"
+        ? telemetry_monitor::file_format::prometheus
+        : telemetry_monitor::file_format::json_lines
+    );
+
+  stop_when_stopped_controller swsc;
+  monitor.start();
+  auto run = async(launch::async, [&]() {
+    return monte_carlo_parallel<telemetry_type, bool>(
+      ex, swsc, op, default_monte_carlo_chunk_size,
+      telemetry_type(monitor, pi_estimate)
+    );
+  });
+
+  cout
+      << setw(10) << "seconds"
+      << setw(14) << "samples"
+      << setw(14) << "samples/sec"
+      << setw(22) << "estimate of pi"
+      << setw(12) << "imbalance"
+      << '\n';
+
+  size_t printed = 0;
+  auto print_new = [&]() {
+    auto const history = monitor.history();
+    for (; printed < history.size(); ++printed) {
+      auto const& s = history[printed];
+      cout
+          << setw(10) << setprecision(4) << s.seconds
+          << setw(14) << s.samples
+          << setw(14) << setprecision(4) << s.samples_per_second
+          << setw(22) << setprecision(15) << s.estimate
+          << setw(12) << setprecision(3) << s.imbalance
+          << endl;
+    }
+  };
+
+  for (int i = 0; i != 8; ++i) {
+    this_thread::sleep_for(250ms);
+    print_new();
+  }
+
+  swsc.stop();
+  auto const total = run.get();
+  monitor.stop();
+  print_new();
+
+  cout
+      << setprecision(15)
+      << "Final estimate of pi = " << pi_estimate(total.get())
+      << " (" << total.count() << " samples)" << endl;
+
+  return too_slow ? 1 : 0;
+}
@@ -6,20 +6,375 @@
 
 //===========================================================================
 
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+//===========================================================================
+//
+// Specialized kernels
+//
+// The drivers below check the controller after every sample (or block).
+// For some controllers and tallies that check, or the tallying, is dead
+// work and the drivers select a simpler loop at compile time instead:
+//
+//   * a controller with a static constexpr bool never_stops = true member
+//     (e.g., never_stop_controller) is never called,
+//
+//   * a controller with a static constexpr bool counts_only = true member
+//     and a count() member function (e.g., stop_after_count_controller) is
+//     only used to compute the number of samples up front, which then run
+//     in a counted, unrolled loop (in the batched drivers: whole blocks of
+//     BlockSize samples and one partial block, with no controller call or
+//     remaining() between blocks). The tally's count() must go up by one
+//     for each sample tallied. If the controller also has a static
+//     constexpr fixed_count member (e.g., stop_after_fixed_count_controller)
+//     monte_carlo() uses it as a compile-time trip count,
+//
+//   * a tally with a static constexpr bool is_stateless = true member
+//     (e.g., tally_nothing) is not called at all --only op is-- in the
+//     never-stop loops and in the batched drivers. (The general per-sample
+//     loop passes the tally's result to the controller and the counted
+//     loops need its count(), which tally_nothing does not have.) This is
+//     opt-in since a tally may have side effects even if it has no state.
+//
+// The results are the same as the general loops'.
+//
+//===========================================================================
+
+namespace monte_carlo_detail {
+
+template <typename Controller, typename = void>
+struct is_never_stop_controller : std::false_type { };
+
+template <typename Controller>
+struct is_never_stop_controller<
+  Controller,
+  std::void_t<decltype(Controller::never_stops)>
+> : std::bool_constant<Controller::never_stops> { };
+
+template <typename Controller, typename = void>
+struct is_count_controller : std::false_type { };
+
+template <typename Controller>
+struct is_count_controller<
+  Controller,
+  std::void_t<
+    decltype(Controller::counts_only),
+    decltype(std::size_t(std::declval<Controller const&>().count()))
+  >
+> : std::bool_constant<Controller::counts_only> { };
+
+template <typename Controller, typename = void>
+struct has_fixed_count : std::false_type { };
+
+template <typename Controller>
+struct has_fixed_count<
+  Controller,
+  std::void_t<std::integral_constant<std::size_t, Controller::fixed_count>>
+> : is_count_controller<Controller> { };
+
+template <typename Tally, typename = void>
+struct is_stateless_tally : std::false_type { };
+
+template <typename Tally>
+struct is_stateless_tally<
+  Tally,
+  std::void_t<decltype(std::remove_reference_t<Tally>::is_stateless)>
+> : std::bool_constant<std::remove_reference_t<Tally>::is_stateless> { };
+
+template <typename Controller>
+using controller_t = std::remove_cv_t<std::remove_reference_t<Controller>>;
+
+inline constexpr std::size_t counted_loop_unroll = 8;
+
+template <typename Tally, typename Op>
+inline void sample_once(Tally& tally, Op& op)
+{
+  if constexpr(is_stateless_tally<Tally>::value)
+    op();
+  else
+    tally(op());
+}
+
+// run n samples (n may be a std::integral_constant)...
+template <typename Tally, typename Op, typename Count>
+inline void counted_samples(Tally& tally, Op& op, Count const n)
+{
+  for (std::size_t i = n / counted_loop_unroll; i != 0; --i)
+    for (std::size_t j = 0; j != counted_loop_unroll; ++j)
+      sample_once(tally, op);
+  for (std::size_t i = n % counted_loop_unroll; i != 0; --i)
+    sample_once(tally, op);
+}
+
+template <typename Controller, typename Tally, typename Op>
+inline void sample_loop(Controller& c, Tally& tally, Op& op)
+{
+  if constexpr(is_never_stop_controller<controller_t<Controller>>::value)
+  {
+    for (;;)
+      sample_once(tally, op);
+  }
+  else if constexpr(is_count_controller<controller_t<Controller>>::value)
+  {
+    // like the loop below: one sample, then until count() reaches c.count()
+    std::size_t const n = c.count();
+    counted_samples(tally, op, tally.count() < n ? n - tally.count() : 1);
+  }
+  else
+    while (c(tally(op())))
+      ;
+}
+
+} // namespace monte_carlo_detail
+
+//===========================================================================
+
 template <typename Tally, typename Controller, typename Op>
 inline Tally monte_carlo(Controller&& c, Op op)
 {
+  using namespace monte_carlo_detail;
+  using controller_type = controller_t<Controller>;
+
   Tally tally;
-  while (c(tally(op())))
-    ;
+  if constexpr(has_fixed_count<controller_type>::value)
+    counted_samples(
+      tally, op,
+      std::integral_constant<
+        std::size_t, std::max<std::size_t>(controller_type::fixed_count, 1)
+      >{}
+    );
+  else
+    sample_loop(c, tally, op);
   return tally;
 }
 
 template <typename Controller, typename Tally, typename Op>
 inline Tally const& monte_carlo_tally(Controller&& c, Tally&& tally, Op op)
 {
-  while (c(tally(op())))
-    ;
+  monte_carlo_detail::sample_loop(c, tally, op);
+  return tally;
+}
+
+//===========================================================================
+//
+// Batched Monte Carlo drivers
+//
+// monte_carlo_batched() and monte_carlo_tally_batched() produce samples in
+// blocks of (at most) BlockSize samples. Each block is:
+//
+//   1) filled by op, then,
+//   2) consumed by the tally all at once, then,
+//   3) checked by the controller once.
+//
+// The batch protocol is optional for every participant --if a participant
+// does not support it, the driver falls back to the per-sample protocol:
+//
+//   * Op: a "block op" is callable as op(first, last) with Sample*
+//     arguments and fills [first,last) with samples. Otherwise op() is
+//     called once per sample to fill the block. When Sample is void it is
+//     deduced from op()'s return type.
+//
+//   * Tally: a "bulk tally" has an operator ()(first, last) that tallies
+//     all samples in [first,last) and returns the tally. Otherwise the
+//     tally's operator ()(sample) is called for each sample.
+//
+//   * Controller: a controller may provide operator ()(tally, n) which is
+//     passed the number of samples n tallied in the last block. Otherwise
+//     operator ()(tally) is called. A controller may also provide
+//     remaining(tally) returning the number of samples left before it
+//     would stop, so that count-based controllers stop on exactly the
+//     same count as they would with monte_carlo() --except for a count of
+//     0 (or a tally that already holds the count): monte_carlo() always
+//     runs at least one sample (it checks the controller after each
+//     sample) whereas the batched drivers run none.
+//
+//===========================================================================
+
+inline constexpr std::size_t default_monte_carlo_block_size = 1024;
+
+namespace monte_carlo_detail {
+
+template <typename Sample, typename Op>
+struct sample_type
+{
+  using type = Sample;
+};
+
+template <typename Op>
+struct sample_type<void, Op>
+{
+  using type = std::decay_t<std::invoke_result_t<Op&>>;
+};
+
+template <typename Op, typename Sample, typename = void>
+struct is_block_op : std::false_type { };
+
+template <typename Op, typename Sample>
+struct is_block_op<
+  Op, Sample,
+  std::void_t<
+    decltype(std::declval<Op&>()(
+      std::declval<Sample*>(), std::declval<Sample*>()
+    ))
+  >
+> : std::true_type { };
+
+template <typename Tally, typename Sample, typename = void>
+struct is_bulk_tally : std::false_type { };
+
+template <typename Tally, typename Sample>
+struct is_bulk_tally<
+  Tally, Sample,
+  std::void_t<
+    decltype(std::declval<Tally&>()(
+      std::declval<Sample const*>(), std::declval<Sample const*>()
+    ))
+  >
+> : std::true_type { };
+
+template <typename Controller, typename Tally, typename = void>
+struct is_block_controller : std::false_type { };
+
+template <typename Controller, typename Tally>
+struct is_block_controller<
+  Controller, Tally,
+  std::void_t<
+    decltype(bool(std::declval<Controller&>()(
+      std::declval<Tally const&>(), std::size_t{}
+    )))
+  >
+> : std::true_type { };
+
+template <typename Controller, typename Tally, typename = void>
+struct has_remaining : std::false_type { };
+
+template <typename Controller, typename Tally>
+struct has_remaining<
+  Controller, Tally,
+  std::void_t<
+    decltype(std::declval<Controller&>().remaining(
+      std::declval<Tally const&>()
+    ))
+  >
+> : std::true_type { };
+
+template <typename Sample, typename Op>
+inline void fill_block(Op& op, Sample* first, Sample* last)
+{
+  if constexpr(is_block_op<Op, Sample>::value)
+    op(first, last);
+  else
+    for (; first != last; ++first)
+      *first = op();
+}
+
+template <typename Tally, typename Sample>
+inline void tally_block(Tally& tally, Sample const* first, Sample const* last)
+{
+  if constexpr(is_bulk_tally<Tally, Sample>::value)
+    tally(first, last);
+  else
+    for (; first != last; ++first)
+      tally(*first);
+}
+
+template <std::size_t BlockSize, typename Controller, typename Tally>
+inline std::size_t next_block_size(Controller& c, Tally const& tally)
+{
+  if constexpr(has_remaining<Controller, Tally>::value)
+    return std::min<std::size_t>(BlockSize, c.remaining(tally));
+  else
+    return BlockSize;
+}
+
+template <typename Controller, typename Tally>
+inline bool control_block(Controller& c, Tally const& tally, std::size_t n)
+{
+  if constexpr(is_block_controller<Controller, Tally>::value)
+    return c(tally, n);
+  else
+    return c(tally);
+}
+
+template <typename Sample, typename Op, typename Tally>
+inline void run_block(Op& op, Tally& tally, Sample* first, Sample* last)
+{
+  fill_block<Sample>(op, first, last);
+  if constexpr(!is_stateless_tally<Tally>::value)
+    tally_block<Tally, Sample>(tally, first, last);
+}
+
+} // namespace monte_carlo_detail
+
+//===========================================================================
+
+template <
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Controller,
+  typename Tally,
+  typename Op
+>
+inline Tally const& monte_carlo_tally_batched(
+  Controller&& c, Tally&& tally, Op op
+)
+{
+  static_assert(BlockSize != 0, "BlockSize must be positive");
+  using namespace monte_carlo_detail;
+  using sample_t = typename sample_type<Sample, Op>::type;
+
+  std::array<sample_t, BlockSize> block;
+  sample_t* const first = block.data();
+
+  if constexpr(is_never_stop_controller<controller_t<Controller>>::value)
+  {
+    for (;;)
+      run_block(op, tally, first, first + BlockSize);
+  }
+  else if constexpr(is_count_controller<controller_t<Controller>>::value)
+  {
+    // whole blocks have a constant trip count (see "Specialized kernels")...
+    std::size_t const count = c.count();
+    std::size_t const n = tally.count() < count ? count - tally.count() : 0;
+    for (std::size_t i = n / BlockSize; i != 0; --i)
+      run_block(op, tally, first, first + BlockSize);
+    if (n % BlockSize != 0)
+      run_block(op, tally, first, first + n % BlockSize);
+  }
+  else
+  {
+    std::size_t n;
+    do
+    {
+      n = next_block_size<BlockSize>(c, tally);
+      if (n == 0)
+        break;
+
+      run_block(op, tally, first, first + n);
+    }
+    while (control_block(c, tally, n));
+  }
+
+  return tally;
+}
+
+template <
+  typename Tally,
+  typename Sample = void,
+  std::size_t BlockSize = default_monte_carlo_block_size,
+  typename Controller,
+  typename Op
+>
+inline Tally monte_carlo_batched(Controller&& c, Op op)
+{
+  Tally tally;
+  monte_carlo_tally_batched<Sample, BlockSize>(
+    std::forward<Controller>(c), tally, std::move(op)
+  );
   return tally;
 }
 
@@ -0,0 +1,51 @@
+// Brejvinder
+#ifndef pi_kernel_utils_hxx_
+#define pi_kernel_utils_hxx_
+
+//===========================================================================
+
+#include <cstddef>
+#include <algorithm>
+
+//===========================================================================
+
+//
+// in_unit_circle_block_op<Engine, Real, BlockSize>
+// class
+//
+// This is a "block op" for monte_carlo_batched(). Each call fills
+// [first,last) with whether uniformly random points in the unit square fall
+// inside the unit circle. Coordinates are drawn in bulk from Engine, which
+// must have a generate(Real*, Real*) member function (e.g.,
+// simd_xoshiro256plus). The test compares the squared distance, i.e.,
+// x*x + y*y <= 1, which avoids sqrt() and pow() and vectorizes.
+//
+// The engine is held by reference so that it can be shared by successive
+// calls and be thread_local in multithreaded code.
+//
+template <typename Engine, typename Real = double, std::size_t BlockSize = 1024>
+class in_unit_circle_block_op {
+ private:
+  Engine* engine_;
+
+ public:
+  explicit in_unit_circle_block_op(Engine& e) noexcept : engine_(&e) {}
+
+  template <typename OutIt>
+  void operator ()(OutIt first, OutIt last) {
+    alignas(64) Real x[BlockSize];
+    alignas(64) Real y[BlockSize];
+
+    while (first != last) {
+      std::size_t const n = std::min<std::size_t>(BlockSize, last - first);
+      engine_->generate(x, x + n);
+      engine_->generate(y, y + n);
+      for (std::size_t i = 0; i != n; ++i, ++first)
+        *first = (x[i] * x[i] + y[i] * y[i] <= Real(1));
+    }
+  }
+};
+
+//===========================================================================
+
+#endif // #ifndef pi_kernel_utils_hxx_
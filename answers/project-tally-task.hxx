@@ -21,6 +21,10 @@ class tally_predicate {
  public:
   tally_predicate() : n_() , true_() {}
 
+  // restore a tally from its counts (e.g., from a checkpoint)...
+  tally_predicate(size_type n, size_type true_count) :
+    n_(n) , true_(true_count) {}
+
   tally_predicate(tally_predicate const& t) = default;
   tally_predicate(tally_predicate&& t) = default;
   tally_predicate& operator =(tally_predicate const& t) = default;
@@ -56,6 +60,18 @@ class tally_predicate {
     true_ += bool(t);
     return *this;
   }
+
+  // bulk form used by the batched monte_carlo drivers...
+  template <typename InputIt>
+  tally_predicate& operator ()(InputIt first, InputIt last) {
+    size_type n = 0;
+    size_type t = 0;
+    for (; first != last; ++first, ++n)
+      t += bool(*first);
+    n_ += n;
+    true_ += t;
+    return *this;
+  }
 };
 
 //===========================================================================
@@ -6,11 +6,19 @@
 
 //===========================================================================
 
+#include <array>
+#include <limits>
 #include <random>
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <type_traits>
 
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
 //===========================================================================
 
 //
@@ -80,4 +88,688 @@ inline std::mt19937_64 make_randomly_seeded_mt19937_64_engine()
 
 //===========================================================================
 
+//
+// splitmix64(state)
+// function
+//
+// This function advances state and returns the next SplitMix64 output. It
+// is used to expand a single 64-bit seed into the state of the xoshiro
+// engines below (as recommended by the xoshiro authors).
+//
+constexpr std::uint64_t splitmix64(std::uint64_t& state) noexcept
+{
+  std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+//
+// uint64_to_unit_double(x), uint32_to_unit_float(x)
+// functions
+//
+// These functions map the high bits of x onto [0,1) by filling a floating
+// point mantissa with them and subtracting one. The same bit trick is used
+// by the SIMD code paths since AVX2 has no 64-bit integer to double
+// conversion --so all code paths produce identical values.
+//
+inline double uint64_to_unit_double(std::uint64_t const x) noexcept
+{
+  std::uint64_t const bits = (x >> 12) | 0x3ff0000000000000ULL;
+  double d;
+  std::memcpy(&d, &bits, sizeof d);
+  return d - 1.0;
+}
+
+inline float uint32_to_unit_float(std::uint32_t const x) noexcept
+{
+  std::uint32_t const bits = (x >> 9) | 0x3f800000U;
+  float f;
+  std::memcpy(&f, &bits, sizeof f);
+  return f - 1.0f;
+}
+
+//===========================================================================
+
+//
+// xoshiro256plus
+// class
+//
+// This is Blackman and Vigna's xoshiro256+ generator. It satisfies the
+// UniformRandomBitGenerator requirements so it can be used with the
+// <random> distributions. It is intended for generating floating-point
+// values (its lowest bits are weaker than its high bits).
+//
+// jump() advances the state by 2**128 steps and long_jump() by 2**192
+// steps. These are used to produce non-overlapping subsequences.
+//
+class xoshiro256plus
+{
+public:
+  using result_type = std::uint64_t;
+  using state_type = std::array<std::uint64_t,4>;
+
+private:
+  state_type s_;
+
+  static constexpr std::uint64_t rotl(
+    std::uint64_t const x, int const k
+  ) noexcept
+  {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  void jump_by(state_type const& poly) noexcept
+  {
+    state_type t{};
+    for (auto const& p : poly)
+      for (int b = 0; b != 64; ++b)
+      {
+        if (p & (std::uint64_t(1) << b))
+          for (std::size_t i = 0; i != t.size(); ++i)
+            t[i] ^= s_[i];
+        (*this)();
+      }
+    s_ = t;
+  }
+
+public:
+  explicit xoshiro256plus(std::uint64_t seed = 0) noexcept
+  {
+    this->seed(seed);
+  }
+
+  explicit xoshiro256plus(state_type const& s) noexcept :
+    s_(s)
+  {
+  }
+
+  void seed(std::uint64_t seed) noexcept
+  {
+    for (auto& w : s_)
+      w = splitmix64(seed);
+  }
+
+  static constexpr result_type min() noexcept
+  {
+    return std::numeric_limits<result_type>::min();
+  }
+
+  static constexpr result_type max() noexcept
+  {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  state_type const& state() const noexcept
+  {
+    return s_;
+  }
+
+  result_type operator ()() noexcept
+  {
+    result_type const result = s_[0] + s_[3];
+    std::uint64_t const t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+  void jump() noexcept
+  {
+    jump_by({
+      0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+      0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    });
+  }
+
+  void long_jump() noexcept
+  {
+    jump_by({
+      0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL,
+      0x77710069854ee241ULL, 0x39109bb02acbe635ULL
+    });
+  }
+};
+
+//===========================================================================
+
+//
+// simd_xoshiro256plus
+// class
+//
+// This runs lanes (8) independent xoshiro256+ generators side-by-side with
+// their states stored as a structure of arrays so that one step of all
+// lanes maps onto one AVX-512 register (or two AVX2 registers) per state
+// word. Lane i starts i jump()s (i.e., i * 2**128 steps) after lane 0, so
+// the lanes never overlap.
+//
+// generate(first,last) fills [first,last) with uniform values in [0,1).
+// Value k * lanes + i is lane i's k-th value. doubles use 52 high bits per
+// 64-bit output; floats use 23 high bits of each 32-bit half of a 64-bit
+// output, i.e., 2 floats per lane per step.
+//
+// For both doubles and floats, an AVX-512 or AVX2 code path is selected at
+// compile-time (e.g., with -march=native) and a portable scalar loop is
+// used otherwise. All code paths produce identical values. If the
+// requested count is not a multiple of the values produced by one step,
+// the unused values of the last step are discarded.
+//
+class simd_xoshiro256plus
+{
+public:
+  using result_type = std::uint64_t;
+  static constexpr std::size_t lanes = 8;
+
+private:
+  alignas(64) std::uint64_t s_[4][lanes];
+
+  template <typename Body>
+  void step_scalar(Body&& body) noexcept
+  {
+    for (std::size_t i = 0; i != lanes; ++i)
+    {
+      std::uint64_t const result = s_[0][i] + s_[3][i];
+      std::uint64_t const t = s_[1][i] << 17;
+      s_[2][i] ^= s_[0][i];
+      s_[3][i] ^= s_[1][i];
+      s_[1][i] ^= s_[2][i];
+      s_[0][i] ^= s_[3][i];
+      s_[2][i] ^= t;
+      s_[3][i] = (s_[3][i] << 45) | (s_[3][i] >> 19);
+      body(i, result);
+    }
+  }
+
+  // fill [first,last) where (last - first) is a multiple of lanes...
+  void generate_doubles(double* first, double* last) noexcept;
+
+  // fill [first,last) where (last - first) is a multiple of 2 * lanes...
+  void generate_floats(float* first, float* last) noexcept;
+
+public:
+  explicit simd_xoshiro256plus(std::uint64_t seed = 0) noexcept
+  {
+    this->seed(seed);
+  }
+
+  void seed(std::uint64_t seed) noexcept
+  {
+    xoshiro256plus lane(seed);
+    for (std::size_t i = 0; i != lanes; ++i, lane.jump())
+      for (std::size_t w = 0; w != 4; ++w)
+        s_[w][i] = lane.state()[w];
+  }
+
+  // return lane i's state, e.g., for reproducing it with xoshiro256plus...
+  xoshiro256plus::state_type lane_state(std::size_t const i) const noexcept
+  {
+    return { s_[0][i], s_[1][i], s_[2][i], s_[3][i] };
+  }
+
+  void generate(double* first, double* last) noexcept
+  {
+    std::size_t const n = last - first;
+    std::size_t const bulk = n - n % lanes;
+    generate_doubles(first, first + bulk);
+    if (bulk != n)
+    {
+      alignas(64) double tail[lanes];
+      generate_doubles(tail, tail + lanes);
+      std::copy(tail, tail + (n - bulk), first + bulk);
+    }
+  }
+
+  void generate(float* first, float* last) noexcept
+  {
+    std::size_t const n = last - first;
+    std::size_t const bulk = n - n % (2 * lanes);
+    generate_floats(first, first + bulk);
+    if (bulk != n)
+    {
+      alignas(64) float tail[2 * lanes];
+      generate_floats(tail, tail + 2 * lanes);
+      std::copy(tail, tail + (n - bulk), first + bulk);
+    }
+  }
+};
+
+#if defined(__AVX512F__)
+
+namespace simd_xoshiro256plus_detail {
+
+//
+// The unmasked AVX-512 shifts and rotates of GCC's avx512fintrin.h pass an
+// _mm512_undefined_*() source to their masked builtins, which makes GCC
+// warn (-Wuninitialized) in whichever function they are inlined into. The
+// zero-masking forms with every lane selected compile to the same
+// instructions without an undefined source...
+//
+inline constexpr __mmask8 all_lanes64 = 0xff;
+inline constexpr __mmask16 all_lanes32 = 0xffff;
+
+// advance all lanes by one step and return their outputs...
+inline __m512i step(__m512i& s0, __m512i& s1, __m512i& s2, __m512i& s3)
+{
+  __m512i const result = _mm512_add_epi64(s0, s3);
+  __m512i const t = _mm512_maskz_slli_epi64(all_lanes64, s1, 17);
+  s2 = _mm512_xor_si512(s2, s0);
+  s3 = _mm512_xor_si512(s3, s1);
+  s1 = _mm512_xor_si512(s1, s2);
+  s0 = _mm512_xor_si512(s0, s3);
+  s2 = _mm512_xor_si512(s2, t);
+  s3 = _mm512_maskz_rol_epi64(all_lanes64, s3, 45);
+  return result;
+}
+
+} // namespace simd_xoshiro256plus_detail
+
+inline void simd_xoshiro256plus::generate_doubles(
+  double* first, double* last
+) noexcept
+{
+  using namespace simd_xoshiro256plus_detail;
+
+  __m512i s0 = _mm512_load_si512(s_[0]);
+  __m512i s1 = _mm512_load_si512(s_[1]);
+  __m512i s2 = _mm512_load_si512(s_[2]);
+  __m512i s3 = _mm512_load_si512(s_[3]);
+  __m512i const one_bits = _mm512_set1_epi64(0x3ff0000000000000LL);
+  __m512d const one = _mm512_set1_pd(1.0);
+
+  for (; first != last; first += lanes)
+  {
+    __m512i const result = step(s0, s1, s2, s3);
+    __m512i const bits =
+      _mm512_or_si512(
+        _mm512_maskz_srli_epi64(all_lanes64, result, 12), one_bits
+      );
+    _mm512_storeu_pd(first, _mm512_sub_pd(_mm512_castsi512_pd(bits), one));
+  }
+
+  _mm512_store_si512(s_[0], s0);
+  _mm512_store_si512(s_[1], s1);
+  _mm512_store_si512(s_[2], s2);
+  _mm512_store_si512(s_[3], s3);
+}
+
+inline void simd_xoshiro256plus::generate_floats(
+  float* first, float* last
+) noexcept
+{
+  using namespace simd_xoshiro256plus_detail;
+
+  __m512i s0 = _mm512_load_si512(s_[0]);
+  __m512i s1 = _mm512_load_si512(s_[1]);
+  __m512i s2 = _mm512_load_si512(s_[2]);
+  __m512i s3 = _mm512_load_si512(s_[3]);
+  __m512i const one_bits = _mm512_set1_epi32(0x3f800000);
+  __m512 const one = _mm512_set1_ps(1.0f);
+
+  // the 32-bit halves of the outputs, low half first...
+  for (; first != last; first += 2 * lanes)
+  {
+    __m512i const result = step(s0, s1, s2, s3);
+    __m512i const bits =
+      _mm512_or_si512(
+        _mm512_maskz_srli_epi32(all_lanes32, result, 9), one_bits
+      );
+    _mm512_storeu_ps(first, _mm512_sub_ps(_mm512_castsi512_ps(bits), one));
+  }
+
+  _mm512_store_si512(s_[0], s0);
+  _mm512_store_si512(s_[1], s1);
+  _mm512_store_si512(s_[2], s2);
+  _mm512_store_si512(s_[3], s3);
+}
+
+#elif defined(__AVX2__)
+
+namespace simd_xoshiro256plus_detail {
+
+// advance half of the lanes by one step and return their outputs...
+inline __m256i step(__m256i& s0, __m256i& s1, __m256i& s2, __m256i& s3)
+{
+  __m256i const result = _mm256_add_epi64(s0, s3);
+  __m256i const t = _mm256_slli_epi64(s1, 17);
+  s2 = _mm256_xor_si256(s2, s0);
+  s3 = _mm256_xor_si256(s3, s1);
+  s1 = _mm256_xor_si256(s1, s2);
+  s0 = _mm256_xor_si256(s0, s3);
+  s2 = _mm256_xor_si256(s2, t);
+  s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+  return result;
+}
+
+// run nsteps steps calling body(k, h, outputs) for step k of each half h
+// of the lanes...
+template <std::size_t Lanes, typename Body>
+inline void steps(
+  std::uint64_t (&s)[4][Lanes], std::size_t const nsteps, Body&& body
+)
+{
+  constexpr std::size_t half = Lanes / 2;
+  auto load = [](std::uint64_t const* p) {
+    return _mm256_load_si256(reinterpret_cast<__m256i const*>(p));
+  };
+  auto store = [](std::uint64_t* p, __m256i v) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p), v);
+  };
+
+  __m256i s0[2] = { load(s[0]), load(s[0] + half) };
+  __m256i s1[2] = { load(s[1]), load(s[1] + half) };
+  __m256i s2[2] = { load(s[2]), load(s[2] + half) };
+  __m256i s3[2] = { load(s[3]), load(s[3] + half) };
+
+  for (std::size_t k = 0; k != nsteps; ++k)
+    for (std::size_t h = 0; h != 2; ++h)
+      body(k, h, step(s0[h], s1[h], s2[h], s3[h]));
+
+  for (std::size_t h = 0; h != 2; ++h)
+  {
+    store(s[0] + h * half, s0[h]);
+    store(s[1] + h * half, s1[h]);
+    store(s[2] + h * half, s2[h]);
+    store(s[3] + h * half, s3[h]);
+  }
+}
+
+} // namespace simd_xoshiro256plus_detail
+
+inline void simd_xoshiro256plus::generate_doubles(
+  double* first, double* last
+) noexcept
+{
+  constexpr std::size_t half = lanes / 2;
+  __m256i const one_bits = _mm256_set1_epi64x(0x3ff0000000000000LL);
+  __m256d const one = _mm256_set1_pd(1.0);
+
+  simd_xoshiro256plus_detail::steps(s_, (last - first) / lanes,
+    [&](std::size_t k, std::size_t h, __m256i result) {
+      __m256i const bits =
+        _mm256_or_si256(_mm256_srli_epi64(result, 12), one_bits);
+      _mm256_storeu_pd(
+        first + k * lanes + h * half,
+        _mm256_sub_pd(_mm256_castsi256_pd(bits), one)
+      );
+    }
+  );
+}
+
+inline void simd_xoshiro256plus::generate_floats(
+  float* first, float* last
+) noexcept
+{
+  __m256i const one_bits = _mm256_set1_epi32(0x3f800000);
+  __m256 const one = _mm256_set1_ps(1.0f);
+
+  // the 32-bit halves of the outputs, low half first...
+  simd_xoshiro256plus_detail::steps(s_, (last - first) / (2 * lanes),
+    [&](std::size_t k, std::size_t h, __m256i result) {
+      __m256i const bits =
+        _mm256_or_si256(_mm256_srli_epi32(result, 9), one_bits);
+      _mm256_storeu_ps(
+        first + k * 2 * lanes + h * lanes,
+        _mm256_sub_ps(_mm256_castsi256_ps(bits), one)
+      );
+    }
+  );
+}
+
+#else
+
+inline void simd_xoshiro256plus::generate_doubles(
+  double* first, double* last
+) noexcept
+{
+  for (; first != last; first += lanes)
+    step_scalar([first](std::size_t i, std::uint64_t r) {
+      first[i] = uint64_to_unit_double(r);
+    });
+}
+
+inline void simd_xoshiro256plus::generate_floats(
+  float* first, float* last
+) noexcept
+{
+  for (; first != last; first += 2 * lanes)
+    step_scalar([first](std::size_t i, std::uint64_t r) {
+      first[2 * i] = uint32_to_unit_float(std::uint32_t(r));
+      first[2 * i + 1] = uint32_to_unit_float(std::uint32_t(r >> 32));
+    });
+}
+
+#endif
+
+//
+// make_randomly_seeded_simd_xoshiro256plus()
+// function
+//
+// This function returns a simd_xoshiro256plus engine seeded from
+// std::random_device.
+//
+inline simd_xoshiro256plus make_randomly_seeded_simd_xoshiro256plus()
+{
+  std::random_device rd;
+  std::uint64_t const seed = (std::uint64_t(rd()) << 32) ^ rd();
+  return simd_xoshiro256plus(seed);
+}
+
+//===========================================================================
+
+//
+// philox4x32
+// class
+//
+// This is the Philox4x32-10 counter-based generator of Salmon et al.
+// ("Parallel Random Numbers: As Easy as 1, 2, 3", SC'11). Each 128-bit
+// counter value is encrypted with a 64-bit key to give four 32-bit (i.e.,
+// two 64-bit) outputs. The engine satisfies the UniformRandomBitGenerator
+// requirements.
+//
+// The key is the seed and the high 64 bits of the counter are a stream
+// number, so philox4x32(seed, k) is the k-th of 2**64 non-overlapping
+// streams (each 2**64 blocks long) and creating it is O(1). discard(n) is
+// also O(1).
+//
+// state() and the state_type constructor allow the exact position in a
+// stream to be saved and restored.
+//
+class philox4x32
+{
+public:
+  using result_type = std::uint64_t;
+
+  struct state_type
+  {
+    std::uint64_t key;
+    std::uint64_t stream;
+    std::uint64_t block;    // the next block to encrypt
+    std::uint32_t index;    // outputs of the last block already used (0-2)
+  };
+
+private:
+  std::uint64_t key_;
+  std::uint64_t stream_;
+  std::uint64_t block_;
+  std::uint32_t index_;
+  std::uint64_t out_[2];
+
+  static constexpr std::uint32_t m0 = 0xd2511f53U;
+  static constexpr std::uint32_t m1 = 0xcd9e8d57U;
+  static constexpr std::uint32_t w0 = 0x9e3779b9U;
+  static constexpr std::uint32_t w1 = 0xbb67ae85U;
+
+  // encrypt counter (block, stream) with key giving two 64-bit outputs...
+  static void encrypt(
+    std::uint64_t const key,
+    std::uint64_t const stream,
+    std::uint64_t const block,
+    std::uint64_t* out
+  ) noexcept
+  {
+    std::uint32_t c0 = std::uint32_t(block);
+    std::uint32_t c1 = std::uint32_t(block >> 32);
+    std::uint32_t c2 = std::uint32_t(stream);
+    std::uint32_t c3 = std::uint32_t(stream >> 32);
+    std::uint32_t k0 = std::uint32_t(key);
+    std::uint32_t k1 = std::uint32_t(key >> 32);
+
+    for (int round = 0; round != 10; ++round)
+    {
+      std::uint64_t const p0 = std::uint64_t(m0) * c0;
+      std::uint64_t const p1 = std::uint64_t(m1) * c2;
+      std::uint32_t const n0 = std::uint32_t(p1 >> 32) ^ c1 ^ k0;
+      std::uint32_t const n2 = std::uint32_t(p0 >> 32) ^ c3 ^ k1;
+      c1 = std::uint32_t(p1);
+      c3 = std::uint32_t(p0);
+      c0 = n0;
+      c2 = n2;
+      k0 += w0;
+      k1 += w1;
+    }
+
+    out[0] = (std::uint64_t(c1) << 32) | c0;
+    out[1] = (std::uint64_t(c3) << 32) | c2;
+  }
+
+  void refill() noexcept
+  {
+    encrypt(key_, stream_, block_++, out_);
+    index_ = 0;
+  }
+
+public:
+  explicit philox4x32(
+    std::uint64_t const seed = 0, std::uint64_t const stream = 0
+  ) noexcept :
+    key_{seed},
+    stream_{stream},
+    block_{},
+    index_{2},
+    out_{}
+  {
+  }
+
+  explicit philox4x32(state_type const& s) noexcept :
+    key_{s.key},
+    stream_{s.stream},
+    block_{s.block},
+    index_{2},
+    out_{}
+  {
+    if (s.index < 2 && s.block != 0)
+    {
+      encrypt(key_, stream_, block_ - 1, out_);
+      index_ = s.index;
+    }
+  }
+
+  static constexpr result_type min() noexcept
+  {
+    return std::numeric_limits<result_type>::min();
+  }
+
+  static constexpr result_type max() noexcept
+  {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  state_type state() const noexcept
+  {
+    return { key_, stream_, block_, index_ };
+  }
+
+  result_type operator ()() noexcept
+  {
+    if (index_ == 2)
+      refill();
+    return out_[index_++];
+  }
+
+  void discard(unsigned long long n) noexcept
+  {
+    std::uint64_t const buffered = 2 - index_;
+    if (n <= buffered)
+    {
+      index_ += std::uint32_t(n);
+      return;
+    }
+    n -= buffered;
+    block_ += n / 2;
+    index_ = 2;
+    if (n % 2 != 0)
+    {
+      refill();
+      index_ = 1;
+    }
+  }
+
+  // fill [first,last) with uniform values in [0,1)...
+  void generate(double* first, double* last) noexcept
+  {
+    for (; first != last; ++first)
+      *first = uint64_to_unit_double((*this)());
+  }
+};
+
+//===========================================================================
+
+//
+// random_stream_factory<Engine>
+// class template
+//
+// Given a master seed, stream(k) returns stream k's engine, i.e.,
+// Engine(master_seed, k). With a counter-based Engine (e.g., philox4x32,
+// the default) this is O(1) and the streams never overlap. If each chunk
+// of work k draws only from stream(k), a run's results do not depend on
+// the number of threads or on the order in which chunks are scheduled.
+//
+template <typename Engine = philox4x32>
+class random_stream_factory
+{
+public:
+  using engine_type = Engine;
+
+private:
+  std::uint64_t seed_;
+
+public:
+  explicit random_stream_factory(std::uint64_t const master_seed) noexcept :
+    seed_{master_seed}
+  {
+  }
+
+  std::uint64_t seed() const noexcept
+  {
+    return seed_;
+  }
+
+  engine_type stream(std::uint64_t const k) const
+  {
+    return engine_type(seed_, k);
+  }
+};
+
+//
+// make_randomly_seeded_random_stream_factory()
+// function
+//
+// This function returns a random_stream_factory whose master seed is read
+// (once) from std::random_device. The seed() should be recorded if the run
+// needs to be reproduced.
+//
+template <typename Engine = philox4x32>
+inline random_stream_factory<Engine>
+make_randomly_seeded_random_stream_factory()
+{
+  std::random_device rd;
+  return random_stream_factory<Engine>((std::uint64_t(rd()) << 32) ^ rd());
+}
+
+//===========================================================================
+
 #endif // #ifndef random_utils_hxx_
@@ -0,0 +1,52 @@
+// Brejvinder
+//
+// Calls simd_xoshiro256plus::generate() directly (i.e., not through a
+// kernel) so that building this with $(SIMDFLAGS) -Wall -Wextra exercises
+// the vectorized code paths of random-utils.hxx in an ordinary caller, and
+// checks the values against the scalar xoshiro256plus of each lane.
+//
+#include <cstdint>
+#include <iostream>
+
+#include "random-utils.hxx"
+
+using namespace std;
+
+int main() {
+  constexpr size_t lanes = simd_xoshiro256plus::lanes;
+  constexpr size_t steps = 1000;
+
+  simd_xoshiro256plus simd(42);
+  xoshiro256plus lane[lanes];
+  for (size_t i = 0; i != lanes; ++i)
+    lane[i] = xoshiro256plus(simd.lane_state(i));
+
+  // an odd count also exercises the tail handling of generate()...
+  static double d[steps * lanes - 3];
+  static float f[steps * 2 * lanes - 5];
+  simd.generate(begin(d), end(d));
+  simd.generate(begin(f), end(f));
+
+  size_t mismatches = 0;
+  for (size_t k = 0; k != steps; ++k)
+    for (size_t i = 0; i != lanes; ++i) {
+      double const expected = uint64_to_unit_double(lane[i]());
+      size_t const j = k * lanes + i;
+      if (j < size(d) && d[j] != expected)
+        ++mismatches;
+    }
+  for (size_t k = 0; k != steps; ++k)
+    for (size_t i = 0; i != lanes; ++i) {
+      uint64_t const x = lane[i]();
+      size_t const j = k * 2 * lanes + 2 * i;
+      if (j < size(f) && f[j] != uint32_to_unit_float(uint32_t(x)))
+        ++mismatches;
+      if (j + 1 < size(f) &&
+          f[j + 1] != uint32_to_unit_float(uint32_t(x >> 32)))
+        ++mismatches;
+    }
+
+  cout << "simd_xoshiro256plus::generate(): " << mismatches
+       << " mismatches against the scalar lanes\n";
+  return mismatches == 0 ? 0 : 1;
+}
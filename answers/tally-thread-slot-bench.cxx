@@ -0,0 +1,97 @@
+// Brejvinder
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include "tally-utils.hxx"
+#include "benchmark-utils.hxx"
+
+//
+// Returns the average cost in nanoseconds of one tally(...) call when
+// nthreads threads each make nsamples calls on the same PerThreadTally.
+// Each thread makes its first call (i.e., its map insertion or slot
+// registration) under a mutex before timing starts since
+// tally_within_thread_id is not safe for concurrent insertions.
+//
+template <typename PerThreadTally>
+double ns_per_sample(
+  PerThreadTally& tally, std::size_t const nthreads, std::size_t const nsamples
+) {
+  using namespace std;
+
+  mutex m;
+  atomic<size_t> ready{0};
+  vector<double> seconds(nthreads);
+  vector<thread> threads;
+  threads.reserve(nthreads);
+
+  for (size_t i = 0; i != nthreads; ++i)
+    threads.emplace_back([&, i]() {
+      {
+        lock_guard<mutex> guard(m);
+        tally(size_t(0));
+      }
+      ready.fetch_add(1);
+      while (ready.load() != nthreads)
+        this_thread::yield();
+
+      benchmark<chrono::steady_clock> bm(benchmark<chrono::steady_clock>::start_clock);
+      for (size_t n = 1; n != nsamples; ++n)
+        tally(n);
+      bm.stop();
+      seconds[i] = duration_convert<double>(bm.duration()).count();
+    });
+  for (auto& t : threads)
+    t.join();
+
+  double total = 0;
+  for (auto const& s : seconds)
+    total += s;
+  return total / (nthreads * nsamples) * 1e9;
+}
+
+int main() {
+  using namespace std;
+
+  size_t const nsamples = 20'000'000;
+  size_t const ncores = max(1U, thread::hardware_concurrency());
+
+  vector<size_t> nthreads{1, 4};
+  if (ncores != 1 && ncores != 4)
+    nthreads.push_back(ncores);
+
+  cout
+      << "Per-sample cost of tallying into a per-thread tally_count ("
+      << nsamples << " samples per thread).\n"
+      << setw(8) << "threads"
+      << setw(16) << "map (ns)"
+      << setw(16) << "slot (ns)"
+      << setw(10) << "speedup"
+      << '\n';
+
+  for (auto const& n : nthreads) {
+    tally_within_thread_id<tally_count> by_id;
+    auto const map_ns = ns_per_sample(by_id, n, nsamples);
+
+    tally_within_thread_slot<tally_count> by_slot;
+    auto const slot_ns = ns_per_sample(by_slot, n, nsamples);
+
+    if (by_slot.combined().count() != n * nsamples) {
+      cout << "ERROR: slot tallies do not add up.\n";
+      return 1;
+    }
+
+    cout
+        << setw(8) << n
+        << setw(16) << setprecision(4) << map_ns
+        << setw(16) << setprecision(4) << slot_ns
+        << setw(10) << setprecision(3) << map_ns / slot_ns
+        << endl;
+  }
+
+  return 0;
+}
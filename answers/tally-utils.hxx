@@ -6,21 +6,71 @@
 
 //===========================================================================
 
+#include <cmath>
 #include <atomic>
 #include <limits>
+#include <memory>
 #include <thread>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 
+#include "cache-utils.hxx"
+
+//===========================================================================
+
+namespace tally_detail {
+
+template <typename Tally, typename InputIt, typename = void>
+struct has_bulk_call : std::false_type { };
+
+template <typename Tally, typename InputIt>
+struct has_bulk_call<
+  Tally, InputIt,
+  std::void_t<
+    decltype(std::declval<Tally&>()(
+      std::declval<InputIt>(), std::declval<InputIt>()
+    ))
+  >
+> : std::true_type { };
+
+// tally [first,last) in bulk if tally supports it, otherwise per sample...
+template <typename Tally, typename InputIt>
+inline void tally_range(Tally& tally, InputIt first, InputIt last)
+{
+  if constexpr(has_bulk_call<Tally, InputIt>::value)
+    tally(first, last);
+  else
+    for (; first != last; ++first)
+      tally(*first);
+}
+
+} // namespace tally_detail
+
 //===========================================================================
 
 struct tally_nothing
 {
+  // lets the monte_carlo drivers skip calling it (see monte-carlo-utils.hxx)
+  static constexpr bool is_stateless = true;
+
   template <typename T>
   constexpr tally_nothing const& operator ()(T const&) const noexcept
   {
     return *this;
   }
+
+  template <typename InputIt>
+  constexpr tally_nothing const& operator ()(InputIt, InputIt) const noexcept
+  {
+    return *this;
+  }
 };
 
 //===========================================================================
@@ -39,6 +89,12 @@ public:
   {
   }
 
+  // restore a tally from its count (e.g., from a checkpoint)...
+  constexpr explicit tally_count(size_type const n) noexcept :
+    n_{n}
+  {
+  }
+
   constexpr tally_count(tally_count const& t) noexcept = default;
   constexpr tally_count(tally_count&& t) noexcept = default;
   constexpr tally_count& operator =(tally_count const& t) noexcept = default;
@@ -49,35 +105,130 @@ public:
     return n_;
   }
 
+  constexpr tally_count& operator +=(tally_count const& rhs) noexcept
+  {
+    n_ += rhs.n_;
+    return *this;
+  }
+
+  constexpr tally_count operator +(tally_count const& rhs) const noexcept
+  {
+    tally_count tmp(*this);
+    tmp += rhs;
+    return tmp;
+  }
+
   template <typename T>
   constexpr tally_count& operator ()(T const&) noexcept
   {
     ++n_;
     return *this;
   }
+
+  template <typename InputIt>
+  constexpr tally_count& operator ()(InputIt first, InputIt last)
+  {
+    n_ += std::distance(first, last);
+    return *this;
+  }
 };
 
 //===========================================================================
 
-template <typename T>
+//
+// tally_mean_variance<T, Compensated>
+// class template
+//
+// Tallies the count, mean and (sample) variance of the values passed to it.
+//
+// Single values are added with Knuth's recurrence relation and tallies are
+// combined with operator += using the pairwise formulas of Chan, Golub and
+// LeVeque ("Algorithms for Computing the Sample Variance: Analysis and
+// Recommendations", The American Statistician 37(3), 1983). Thus per-thread
+// tallies can be reduced (e.g., by monte_carlo_parallel() or
+// std::transform_reduce()) into the same result as a serial run, up to
+// rounding. The bulk operator ()(first, last) computes the block's mean and
+// variance in two passes and then merges it in the same way.
+//
+// If Compensated is true, the running mean and sum of squared deviations
+// are accumulated with Kahan-Babuska (Neumaier) compensated summation which
+// keeps rounding error from growing with the count in runs of billions of
+// samples.
+//
+template <typename T, bool Compensated = false>
 class tally_mean_variance
 {
 public:
   using value_type = T;
   using size_type = std::size_t;
 
+  static constexpr bool is_compensated = Compensated;
+
+  // the complete state, including the compensation terms...
+  struct state_type
+  {
+    size_type n;
+    value_type mean;
+    value_type m2;
+    value_type mean_c;
+    value_type m2_c;
+  };
+
 private:
   size_type n_;
   value_type mean_;
-  value_type variance_;
-  
+  value_type m2_;
+  value_type mean_c_;
+  value_type m2_c_;
+
+  // sum += x with compensation term c when Compensated...
+  static constexpr void add(value_type& sum, value_type& c, value_type x)
+  {
+    if constexpr(Compensated)
+    {
+      value_type const t = sum + x;
+      if (std::abs(x) <= std::abs(sum))
+        c += (sum - t) + x;
+      else
+        c += (x - t) + sum;
+      sum = t;
+    }
+    else
+      sum += x;
+  }
+
 public:
   constexpr tally_mean_variance() :
     n_{},
     mean_{},
-    variance_{}
+    m2_{},
+    mean_c_{},
+    m2_c_{}
+  {
+  }
+
+  // make a tally from count(), mean() and m2() (see also state())...
+  constexpr tally_mean_variance(
+    size_type const n, value_type const mean, value_type const m2
+  ) :
+    n_{n},
+    mean_{mean},
+    m2_{m2},
+    mean_c_{},
+    m2_c_{}
   {
   }
+
+  // restore a tally exactly from state()...
+  constexpr explicit tally_mean_variance(state_type const& s) :
+    n_{s.n},
+    mean_{s.mean},
+    m2_{s.m2},
+    mean_c_{s.mean_c},
+    m2_c_{s.m2_c}
+  {
+  }
+
   constexpr tally_mean_variance(tally_mean_variance const& t) = default;
   constexpr tally_mean_variance(tally_mean_variance&& t) = default;
   constexpr tally_mean_variance& operator =(tally_mean_variance const& t) = default;
@@ -88,15 +239,27 @@ public:
     return n_;
   }
 
-  constexpr value_type const& mean() const
+  constexpr state_type state() const
   {
-    return mean_;
+    return { n_, mean_, m2_, mean_c_, m2_c_ };
   }
 
+  constexpr value_type mean() const
+  {
+    return mean_ + mean_c_;
+  }
+
+  // return the sum of squared deviations from the mean...
+  constexpr value_type m2() const
+  {
+    return m2_ + m2_c_;
+  }
+
+  // return the (unbiased) sample variance...
   constexpr value_type variance() const
   {
     if (1 < n_)
-      return variance_;
+      return m2() / value_type(n_ - 1);
 
     if constexpr(std::numeric_limits<T>::has_quiet_NaN)
       return std::numeric_limits<T>::quiet_NaN();
@@ -110,20 +273,76 @@ public:
       return T(0);
   }
 
+  // Using Chan et al.'s pairwise update...
+  constexpr tally_mean_variance& operator +=(tally_mean_variance const& rhs)
+  {
+    if (rhs.n_ == 0)
+      return *this;
+    if (n_ == 0)
+      return *this = rhs;
+
+    size_type const n = n_ + rhs.n_;
+    value_type const delta = rhs.mean() - mean();
+    value_type const nb_over_n = value_type(rhs.n_) / value_type(n);
+
+    add(mean_, mean_c_, delta * nb_over_n);
+    add(m2_, m2_c_, rhs.m2());
+    add(m2_, m2_c_, delta * delta * value_type(n_) * nb_over_n);
+    n_ = n;
+    return *this;
+  }
+
+  constexpr tally_mean_variance operator +(
+    tally_mean_variance const& rhs
+  ) const
+  {
+    tally_mean_variance tmp(*this);
+    tmp += rhs;
+    return tmp;
+  }
+
   // Using Knuth's recurrence relation from The Art of Computer Programming
   // 3rd. ed., Vol. 2, Seminumerical Algorithms, Section 4.2.2.
   constexpr tally_mean_variance& operator ()(T const& t)
   {
     ++n_;
-    value_type const delta = t - mean_;
-    mean_ += delta / n_;
-    variance_ += delta * (t - mean_);
+    value_type const delta = t - mean();
+    add(mean_, mean_c_, delta / value_type(n_));
+    add(m2_, m2_c_, delta * (t - mean()));
     return *this;
   }
+
+  template <typename ForwardIt>
+  constexpr tally_mean_variance& operator ()(ForwardIt first, ForwardIt last)
+  {
+    tally_mean_variance block;
+    block.n_ = std::distance(first, last);
+    if (block.n_ == 0)
+      return *this;
+
+    value_type sum{};
+    for (auto i = first; i != last; ++i)
+      sum += *i;
+    block.mean_ = sum / value_type(block.n_);
+
+    for (auto i = first; i != last; ++i)
+    {
+      value_type const d = value_type(*i) - block.mean_;
+      block.m2_ += d * d;
+    }
+
+    return *this += block;
+  }
 };
 
 //===========================================================================
 
+//
+// NOTE: tally_within_thread_id hashes std::this_thread::get_id() on every
+//       call and it is not safe for threads to insert into tally_map_
+//       concurrently, i.e., each thread's entry must be created before
+//       threads tally concurrently. Prefer tally_within_thread_slot.
+//
 template <typename Tally>
 class tally_within_thread_id
 {
@@ -159,6 +378,167 @@ public:
     tally_map_[std::this_thread::get_id()](t);
     return *this;
   }
+
+  template <typename InputIt>
+  tally_within_thread_id& operator ()(InputIt first, InputIt last)
+  {
+    tally_detail::tally_range(
+      tally_map_[std::this_thread::get_id()], first, last
+    );
+    return *this;
+  }
+};
+
+//===========================================================================
+
+//
+// tally_within_thread_slot<Tally>
+// class template
+//
+// This holds one Tally per thread like tally_within_thread_id does, but:
+//
+//   * each thread is given a dense slot index once, when it first tallies
+//     (or calls register_thread()), by an atomic increment, and,
+//   * the tallies are stored in a fixed-capacity array of cache_padded
+//     slots so threads never share a cache line.
+//
+// After registration a thread finds its slot through a small thread_local
+// cache (keyed by a per-instance id) with no hashing or locking. If a
+// thread's cache entry for an instance is evicted (i.e., it tallies into
+// more than max_cached_instances instances), it is simply given a new
+// slot: combined() sums all slots so no tallies are lost.
+//
+// NOTE: get(), size() and combined() must only be used once the threads
+//       that tally have been joined (or otherwise synchronized with).
+//
+template <typename Tally>
+class tally_within_thread_slot
+{
+public:
+  using tally_type = Tally;
+  using size_type = std::size_t;
+
+  static constexpr size_type max_cached_instances = 8;
+
+private:
+  struct cache_entry
+  {
+    std::uint64_t id;
+    size_type slot;
+  };
+
+  size_type capacity_;
+  std::unique_ptr<cache_padded<tally_type>[]> slots_;
+  std::atomic<size_type> nslots_;
+  std::uint64_t id_;
+
+  static std::uint64_t next_id() noexcept
+  {
+    static std::atomic<std::uint64_t> id{1};
+    return id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static std::vector<cache_entry>& thread_cache()
+  {
+    static thread_local std::vector<cache_entry> cache;
+    return cache;
+  }
+
+  size_type slot()
+  {
+    auto& cache = thread_cache();
+    if (!cache.empty() && cache.front().id == id_)
+      return cache.front().slot;
+
+    auto const pos = std::find_if(
+      cache.begin(), cache.end(),
+      [this](cache_entry const& e) { return e.id == id_; }
+    );
+    if (pos != cache.end())
+    {
+      std::iter_swap(cache.begin(), pos);
+      return cache.front().slot;
+    }
+    return register_thread();
+  }
+
+public:
+  static size_type default_capacity() noexcept
+  {
+    return std::max<size_type>(64, 2 * std::thread::hardware_concurrency());
+  }
+
+  explicit tally_within_thread_slot(
+    size_type const capacity = default_capacity()
+  ) :
+    capacity_{capacity},
+    slots_{new cache_padded<tally_type>[capacity]},
+    nslots_{},
+    id_{next_id()}
+  {
+  }
+
+  tally_within_thread_slot(tally_within_thread_slot const&) = delete;
+  tally_within_thread_slot(tally_within_thread_slot&&) = delete;
+  tally_within_thread_slot& operator =(
+    tally_within_thread_slot const&) = delete;
+  tally_within_thread_slot& operator =(tally_within_thread_slot&&) = delete;
+
+  size_type capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+  // the number of registered slots...
+  size_type size() const noexcept
+  {
+    return std::min(nslots_.load(std::memory_order_acquire), capacity_);
+  }
+
+  tally_type const& get(size_type const i) const noexcept
+  {
+    return slots_[i].value;
+  }
+
+  //
+  // Gives the calling thread a new slot and returns its index. Throws
+  // std::length_error if all capacity() slots are in use.
+  //
+  size_type register_thread()
+  {
+    size_type const slot = nslots_.fetch_add(1, std::memory_order_acq_rel);
+    if (capacity_ <= slot)
+      throw std::length_error("tally_within_thread_slot: out of slots");
+
+    auto& cache = thread_cache();
+    if (cache.size() == max_cached_instances)
+      cache.pop_back();
+    cache.insert(cache.begin(), cache_entry{id_, slot});
+    return slot;
+  }
+
+  // return the sum of all slots' tallies using Tally::operator +=...
+  tally_type combined() const
+  {
+    tally_type total;
+    for (size_type i = 0, n = size(); i != n; ++i)
+      total += slots_[i].value;
+    return total;
+  }
+
+  template <typename T>
+  tally_within_thread_slot& operator ()(T const& t)
+  {
+    slots_[slot()].value(t);
+    return *this;
+  }
+
+  template <typename InputIt>
+  tally_within_thread_slot& operator ()(InputIt first, InputIt last)
+  {
+    tally_detail::tally_range(slots_[slot()].value, first, last);
+    return *this;
+  }
 };
 
 //===========================================================================
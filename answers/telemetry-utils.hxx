@@ -0,0 +1,488 @@
+// Brejvinder
+#ifndef telemetry_utils_hxx_
+#define telemetry_utils_hxx_
+
+//===========================================================================
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+
+#include "cache-utils.hxx"
+
+//===========================================================================
+
+//
+// telemetry_slot
+// class
+//
+// One worker's published progress: its sample count and its current
+// estimate. Workers add to the count and store the estimate with relaxed
+// operations and the sampler thread reads them with relaxed loads --the
+// two values may be one publish apart which is fine for monitoring.
+//
+struct alignas(cache_line_size) telemetry_slot
+{
+  std::atomic<std::uint64_t> count{0};
+  std::atomic<double> estimate{0};
+
+  void publish(std::uint64_t const n, double const e) noexcept
+  {
+    estimate.store(e, std::memory_order_relaxed);
+    count.fetch_add(n, std::memory_order_relaxed);
+  }
+};
+
+class telemetry_monitor;
+
+//===========================================================================
+
+//
+// telemetry_tally<Tally, Estimator, PublishInterval>
+// class template
+//
+// Wraps a Tally and, every PublishInterval (a power of two) samples, adds
+// the number of samples tallied since the last publish to a
+// telemetry_slot and stores estimator(tally) in it. The hot path costs one
+// extra mask-and-compare per sample (or per block with the bulk operator).
+//
+// A telemetry_tally is a regular tally: it is default constructible (and
+// then publishes nothing), copyable, can be merged with operator += and
+// forwards count(), true_count(), mean() and variance() to the wrapped
+// tally, so it works with the monte_carlo drivers and controllers such as
+// stop_at_precision_controller. Only samples tallied through its call
+// operators are published, i.e., tallies merged in with += are not, and a
+// copy is not bound to any slot.
+//
+// To get telemetry from the parallel drivers (monte_carlo_parallel() and
+// the others in executor-utils.hxx, monte_carlo_checkpointed() and
+// monte_carlo_batch::add()), pass them a prototype constructed from the
+// monitor:
+//
+//   telemetry_tally<tally_predicate, decltype(est)> proto(monitor, est);
+//   monte_carlo_parallel_n<decltype(proto), bool>(ex, n, op, chunk, proto);
+//
+// The drivers copy the prototype for each stream and call bind_worker(w)
+// on it before each chunk, which binds it to monitor.slot(w %
+// monitor.size()).
+//
+template <
+  typename Tally,
+  typename Estimator,
+  std::size_t PublishInterval = 4096
+>
+class telemetry_tally
+{
+public:
+  using tally_type = Tally;
+  using size_type = std::size_t;
+
+  static_assert(
+    PublishInterval != 0 && (PublishInterval & (PublishInterval - 1)) == 0,
+    "PublishInterval must be a power of two"
+  );
+
+private:
+  tally_type tally_;
+  telemetry_monitor* monitor_;
+  telemetry_slot* slot_;
+  std::shared_ptr<Estimator const> estimator_;
+  size_type published_;       // tally_.count() at the last publish
+
+  void publish() noexcept
+  {
+    if (slot_ == nullptr)
+      return;
+    slot_->publish(tally_.count() - published_, (*estimator_)(tally_));
+    published_ = tally_.count();
+  }
+
+public:
+  telemetry_tally() :
+    tally_{},
+    monitor_{},
+    slot_{},
+    estimator_{},
+    published_{}
+  {
+  }
+
+  // a tally that publishes to slot...
+  telemetry_tally(telemetry_slot& slot, Estimator estimator) :
+    tally_{},
+    monitor_{},
+    slot_{&slot},
+    estimator_{std::make_shared<Estimator const>(std::move(estimator))},
+    published_{}
+  {
+  }
+
+  // a prototype whose copies publish to monitor's slots (see bind_worker())...
+  telemetry_tally(telemetry_monitor& monitor, Estimator estimator) :
+    tally_{},
+    monitor_{&monitor},
+    slot_{},
+    estimator_{std::make_shared<Estimator const>(std::move(estimator))},
+    published_{}
+  {
+  }
+
+  // an unbound tally holding t (e.g., restored from a checkpoint)...
+  explicit telemetry_tally(tally_type const& t) :
+    tally_{t},
+    monitor_{},
+    slot_{},
+    estimator_{},
+    published_{t.count()}
+  {
+  }
+
+  telemetry_tally(telemetry_tally const& t) :
+    tally_{t.tally_},
+    monitor_{t.monitor_},
+    slot_{},
+    estimator_{t.estimator_},
+    published_{t.tally_.count()}
+  {
+  }
+
+  telemetry_tally& operator =(telemetry_tally const& t)
+  {
+    publish();
+    tally_ = t.tally_;
+    monitor_ = t.monitor_;
+    slot_ = nullptr;
+    estimator_ = t.estimator_;
+    published_ = tally_.count();
+    return *this;
+  }
+
+  ~telemetry_tally()
+  {
+    publish();
+  }
+
+  // publish to worker w's slot of the monitor from now on...
+  void bind_worker(size_type const w);
+
+  tally_type const& get() const noexcept
+  {
+    return tally_;
+  }
+
+  size_type count() const
+  {
+    return tally_.count();
+  }
+
+  template <typename T = Tally>
+  auto true_count() const -> decltype(std::declval<T const&>().true_count())
+  {
+    return tally_.true_count();
+  }
+
+  template <typename T = Tally>
+  auto mean() const -> decltype(std::declval<T const&>().mean())
+  {
+    return tally_.mean();
+  }
+
+  template <typename T = Tally>
+  auto variance() const -> decltype(std::declval<T const&>().variance())
+  {
+    return tally_.variance();
+  }
+
+  telemetry_tally& operator +=(telemetry_tally const& rhs)
+  {
+    tally_ += rhs.tally_;
+    published_ += rhs.tally_.count();
+    return *this;
+  }
+
+  telemetry_tally operator +(telemetry_tally const& rhs) const
+  {
+    telemetry_tally tmp(*this);
+    tmp += rhs;
+    return tmp;
+  }
+
+  template <typename T>
+  telemetry_tally& operator ()(T const& t)
+  {
+    tally_(t);
+    if ((tally_.count() & (PublishInterval - 1)) == 0)
+      publish();
+    return *this;
+  }
+
+  template <typename InputIt>
+  telemetry_tally& operator ()(InputIt first, InputIt last)
+  {
+    size_type const before = tally_.count();
+    tally_(first, last);
+    if (before / PublishInterval != tally_.count() / PublishInterval)
+      publish();
+    return *this;
+  }
+};
+
+//===========================================================================
+
+struct telemetry_sample
+{
+  double seconds;             // since the monitor was started
+  std::uint64_t samples;      // total over all workers
+  double samples_per_second;  // over the last interval
+  double estimate;            // count-weighted mean of worker estimates
+  double imbalance;           // (max - min) / mean worker samples/sec
+};
+
+//===========================================================================
+
+//
+// telemetry_monitor
+// class
+//
+// Owns one telemetry_slot per worker and a sampler thread that, every
+// interval, reads the slots and records a telemetry_sample in a ring buffer
+// of the last capacity samples. Optionally each sample is also written to a
+// file as either a JSON line (appended) or a Prometheus text exposition
+// (the file is rewritten via a temporary file and a rename so readers
+// never see a partial file).
+//
+// The workers only ever touch their own slot, so the monitor adds no
+// contention to the sampling loop.
+//
+class telemetry_monitor
+{
+public:
+  using size_type = std::size_t;
+  using clock_type = std::chrono::steady_clock;
+
+  enum class file_format { none, json_lines, prometheus };
+
+private:
+  std::unique_ptr<telemetry_slot[]> slots_;
+  size_type nworkers_;
+  clock_type::duration interval_;
+
+  std::string path_;
+  file_format format_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_;
+  std::vector<telemetry_sample> ring_;
+  size_type capacity_;
+  size_type next_;
+  std::thread thread_;
+
+  clock_type::time_point start_;
+  clock_type::time_point last_time_;
+  std::vector<std::uint64_t> last_counts_;
+
+  telemetry_sample take_sample()
+  {
+    auto const now = clock_type::now();
+    double const dt =
+      std::chrono::duration<double>(now - last_time_).count();
+
+    telemetry_sample s{};
+    s.seconds = std::chrono::duration<double>(now - start_).count();
+
+    double weighted = 0;
+    double min_rate = 0;
+    double max_rate = 0;
+    for (size_type w = 0; w != nworkers_; ++w)
+    {
+      std::uint64_t const n = slots_[w].count.load(std::memory_order_relaxed);
+      double const e = slots_[w].estimate.load(std::memory_order_relaxed);
+      double const rate = dt > 0 ? (n - last_counts_[w]) / dt : 0;
+
+      s.samples += n;
+      weighted += n * e;
+      min_rate = w == 0 ? rate : std::min(min_rate, rate);
+      max_rate = w == 0 ? rate : std::max(max_rate, rate);
+      s.samples_per_second += rate;
+      last_counts_[w] = n;
+    }
+
+    double const mean_rate = s.samples_per_second / nworkers_;
+    s.estimate = s.samples != 0 ? weighted / s.samples : 0;
+    s.imbalance = mean_rate > 0 ? (max_rate - min_rate) / mean_rate : 0;
+    last_time_ = now;
+    return s;
+  }
+
+  void write_sample(telemetry_sample const& s) const
+  {
+    if (format_ == file_format::json_lines)
+    {
+      std::ofstream out(path_, std::ios::app);
+      out.precision(17);
+      out
+        << "{\"seconds\": " << s.seconds
+        << ", \"samples\": " << s.samples
+        << ", \"samples_per_second\": " << s.samples_per_second
+        << ", \"estimate\": " << s.estimate
+        << ", \"imbalance\": " << s.imbalance
+        << "}\n";
+    }
+    else if (format_ == file_format::prometheus)
+    {
+      std::string const tmp = path_ + ".tmp";
+      {
+        std::ofstream out(tmp, std::ios::trunc);
+        out.precision(17);
+        out
+          << "# TYPE monte_carlo_samples_total counter\n"
+          << "monte_carlo_samples_total " << s.samples << '\n'
+          << "# TYPE monte_carlo_samples_per_second gauge\n"
+          << "monte_carlo_samples_per_second " << s.samples_per_second << '\n'
+          << "# TYPE monte_carlo_estimate gauge\n"
+          << "monte_carlo_estimate " << s.estimate << '\n'
+          << "# TYPE monte_carlo_imbalance gauge\n"
+          << "monte_carlo_imbalance " << s.imbalance << '\n'
+          << "# TYPE monte_carlo_worker_samples_total counter\n";
+        for (size_type w = 0; w != nworkers_; ++w)
+          out
+            << "monte_carlo_worker_samples_total{worker=\"" << w << "\"} "
+            << slots_[w].count.load(std::memory_order_relaxed) << '\n';
+      }
+      std::rename(tmp.c_str(), path_.c_str());
+    }
+  }
+
+  void record()
+  {
+    auto const s = take_sample();
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (ring_.size() < capacity_)
+        ring_.push_back(s);
+      else
+        ring_[next_] = s;
+      next_ = (next_ + 1) % capacity_;
+    }
+    write_sample(s);
+  }
+
+  void sampler_loop()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!cv_.wait_for(lock, interval_, [this]() { return stop_; }))
+    {
+      lock.unlock();
+      record();
+      lock.lock();
+    }
+  }
+
+public:
+  telemetry_monitor(
+    size_type const nworkers,
+    clock_type::duration const interval = std::chrono::milliseconds(100),
+    size_type const capacity = 1024
+  ) :
+    slots_{new telemetry_slot[std::max<size_type>(nworkers, 1)]},
+    nworkers_{std::max<size_type>(nworkers, 1)},
+    interval_{interval},
+    format_{file_format::none},
+    stop_{true},
+    capacity_{std::max<size_type>(capacity, 1)},
+    next_{},
+    last_counts_(nworkers_)
+  {
+  }
+
+  telemetry_monitor(telemetry_monitor const&) = delete;
+  telemetry_monitor& operator =(telemetry_monitor const&) = delete;
+
+  ~telemetry_monitor()
+  {
+    stop();
+  }
+
+  size_type size() const noexcept
+  {
+    return nworkers_;
+  }
+
+  telemetry_slot& slot(size_type const w) noexcept
+  {
+    return slots_[w];
+  }
+
+  // also write every sample to path (call before start())...
+  void write_to(std::string path, file_format const format)
+  {
+    path_ = std::move(path);
+    format_ = format;
+  }
+
+  void start()
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (!stop_)
+      return;
+    stop_ = false;
+    start_ = last_time_ = clock_type::now();
+    thread_ = std::thread([this]() { sampler_loop(); });
+  }
+
+  // stop the sampler thread after recording one final sample...
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (stop_)
+        return;
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    record();
+  }
+
+  // return the recorded samples, oldest first...
+  std::vector<telemetry_sample> history() const
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    std::vector<telemetry_sample> result;
+    result.reserve(ring_.size());
+    size_type const first = ring_.size() < capacity_ ? 0 : next_;
+    for (size_type i = 0; i != ring_.size(); ++i)
+      result.push_back(ring_[(first + i) % ring_.size()]);
+    return result;
+  }
+};
+
+//===========================================================================
+
+template <typename Tally, typename Estimator, std::size_t PublishInterval>
+void telemetry_tally<Tally, Estimator, PublishInterval>::bind_worker(
+  size_type const w
+)
+{
+  if (monitor_ == nullptr)
+    return;
+  publish();
+  slot_ = &monitor_->slot(w % monitor_->size());
+}
+
+//===========================================================================
+
+#endif // #ifndef telemetry_utils_hxx_